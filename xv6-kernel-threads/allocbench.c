@@ -0,0 +1,105 @@
+// Page allocator benchmark: run 1, 2, 4, ... up to nproc processes,
+// each allocating and freeing a burst of pages with kalloc/kfree in
+// the kernel for a fixed number of ticks, and report total pages
+// allocated per tick.  With per-CPU magazines the throughput should
+// grow with the number of CPUs instead of flattening on kmem.lock.
+//
+// "allocbench buddy" instead allocates and frees blocks of mixed
+// orders in one process and checks that they all merge again; run
+// it on an otherwise idle system.
+//
+// usage: allocbench [nproc] [ticks] [burst]
+//        allocbench buddy [ticks]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXPROC 16
+
+void
+bench(int nproc, int nticks, int burst)
+{
+  int fd[2], counts[MAXPROC];
+  int i, n, total;
+
+  if(pipe(fd) < 0){
+    printf(2, "allocbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      n = allocbench(burst, nticks);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+
+  total = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(fd[0], &n, sizeof(n)) != sizeof(n) || n < 0)
+      n = 0;
+    counts[i] = n;
+    total += n;
+  }
+  close(fd[0]);
+  for(i = 0; i < nproc; i++)
+    wait();
+
+  printf(1, "%d procs: %d pages in %d ticks (%d/tick)\n",
+         nproc, total, nticks, total / nticks);
+  printf(1, "  per proc:");
+  for(i = 0; i < nproc; i++)
+    printf(1, " %d", counts[i]);
+  printf(1, "\n");
+}
+
+void
+buddy(int nticks)
+{
+  int n;
+
+  n = allocbench(0, nticks);
+  check("buddy coalesce", n >= 0);
+  if(n >= 0)
+    printf(1, "buddy: %d pages in %d ticks (%d/tick)\n",
+           n, nticks, n / nticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nticks, burst, n;
+
+  if(argc > 1 && strcmp(argv[1], "buddy") == 0){
+    nticks = argc > 2 ? atoi(argv[2]) : 100;
+    if(nticks < 1){
+      printf(2, "usage: allocbench buddy [ticks]\n");
+      exit();
+    }
+    buddy(nticks);
+    exit();
+  }
+
+  nproc = 4;
+  nticks = 100;
+  burst = 8;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nticks = atoi(argv[2]);
+  if(argc > 3)
+    burst = atoi(argv[3]);
+  if(nproc < 1 || nproc > MAXPROC || nticks < 1 || burst < 1 || burst > 64){
+    printf(2, "usage: allocbench [nproc 1-%d] [ticks] [burst 1-64]\n",
+           MAXPROC);
+    exit();
+  }
+
+  for(n = 1; n < nproc; n *= 2)
+    bench(n, nticks, burst);
+  bench(nproc, nticks, burst);
+  exit();
+}
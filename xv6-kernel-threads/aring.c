@@ -0,0 +1,199 @@
+// Asynchronous syscall ring.
+//
+// aring_setup() registers a struct aring in the caller's memory and
+// starts a kernel worker thread inside the process (kthread_run_proc),
+// so the worker sees the same page table, open files and cwd as the
+// process and can run read/write/open/close/fstat just as the syscalls
+// would.  It takes submissions in order and posts one completion for
+// each.  The process only traps when it has to: aring_enter() wakes a
+// sleeping worker and optionally waits for completions.  With AR_POLL
+// the worker keeps polling for AR_IDLE ticks after running out of work
+// before going to sleep, so a busy submitter needs no syscalls at all.
+//
+// The indices are free-running; producer and consumer each own one
+// side.  aringlock only orders the sleep/wakeup handshakes.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "file.h"
+#include "aring.h"
+
+#define AR_IDLE 10   // ticks a polling worker waits for new work
+
+static struct spinlock aringlock;
+
+void
+aringinit(void)
+{
+  initlock(&aringlock, "aring");
+}
+
+// Is [addr, addr+n) inside the process?
+static int
+badrange(uint addr, int n)
+{
+  return n < 0 || !uservalid(addr, n) || vmprefault(addr, n) < 0;
+}
+
+// Run one submission in the worker and return its result.
+static int
+aringop(struct sqe *e)
+{
+  struct file *f;
+  char *path;
+
+  switch(e->op){
+  case AR_OPEN:
+    if(fetchstr(e->addr, &path) < 0)
+      return -1;
+    return openfd(path, e->omode);
+  case AR_CLOSE:
+    return closefd(e->fd);
+  }
+
+  if(e->fd < 0 || e->fd >= NOFILE || (f=proc->ofile[e->fd]) == 0)
+    return -1;
+  switch(e->op){
+  case AR_READ:
+    if(badrange(e->addr, e->n))
+      return -1;
+    return fileread(f, (char*)e->addr, e->n);
+  case AR_WRITE:
+    if(badrange(e->addr, e->n))
+      return -1;
+    return filewrite(f, (char*)e->addr, e->n);
+  case AR_FSTAT:
+    if(badrange(e->addr, sizeof(struct stat)))
+      return -1;
+    return filestat(f, (struct stat*)e->addr);
+  }
+  return -1;
+}
+
+// Body of the worker thread.  arg is the ring, at a user address
+// that is valid because the worker runs on the process's page table.
+static void
+aringwork(void *arg)
+{
+  struct aring *r = arg;
+  struct sqe e;
+  struct cqe *c;
+  uint idle;
+
+  idle = ticks;
+  for(;;){
+    if(proc->killed || proc->aringexit)
+      return;
+
+    // Take submissions while there is room to complete them.
+    if(r->sqhead != r->sqtail && r->cqtail - r->cqhead < NARING){
+      e = r->sq[r->sqhead % NARING];
+      r->sqhead++;
+      c = &r->cq[r->cqtail % NARING];
+      c->tag = e.tag;
+      c->res = aringop(&e);
+      __sync_synchronize();
+      r->cqtail++;
+
+      acquire(&aringlock);
+      wakeup((void*)&r->cqtail);
+      release(&aringlock);
+      idle = ticks;
+      continue;
+    }
+
+    if((r->flags & AR_POLL) && ticks - idle < AR_IDLE){
+      yield();
+      continue;
+    }
+
+    // Nothing to do: sleep until aring_enter.  Publish sleeping
+    // before the final look at sqtail, which the submitter writes
+    // before it looks at sleeping, so one of us sees the other.
+    acquire(&aringlock);
+    r->sleeping = 1;
+    __sync_synchronize();
+    if((r->sqhead == r->sqtail || r->cqtail - r->cqhead >= NARING) &&
+       !proc->killed && !proc->aringexit)
+      sleep(r, &aringlock);
+    r->sleeping = 0;
+    release(&aringlock);
+    idle = ticks;
+  }
+}
+
+// Register r as the calling process's ring and start its worker.
+int
+aringsetup(struct aring *r, int flags)
+{
+  if(proc->aring)
+    return -1;
+  r->sqhead = r->sqtail = 0;
+  r->cqhead = r->cqtail = 0;
+  r->flags = flags;
+  r->sleeping = 0;
+  proc->aring = r;
+  if((proc->aringtid = kthread_run_proc(aringwork, r)) < 0){
+    proc->aring = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// Does the calling process's ring overlap [start, end)?  The worker
+// uses the ring without checking it, so growproc() and munmap()
+// refuse to take its memory away.
+int
+aringpinned(uint start, uint end)
+{
+  uint r;
+
+  r = (uint)proc->aring;
+  return r && r < end && start < r + sizeof(struct aring);
+}
+
+// Drop the calling process's ring, whose memory exec is about
+// to replace, and wait for the worker to finish the operation it
+// is running and return.  Called once exec can no longer fail.
+void
+aringstop(void)
+{
+  acquire(&aringlock);
+  if(proc->aring == 0){
+    release(&aringlock);
+    return;
+  }
+  proc->aringexit = 1;
+  wakeup(proc->aring);
+  release(&aringlock);
+
+  kthread_wait_proc(proc->aringtid);
+  proc->aring = 0;
+  proc->aringexit = 0;
+}
+
+// Wake the worker, then wait until at least min completions are
+// posted.  Returns the number of completions ready.
+int
+aringenter(int min)
+{
+  struct aring *r;
+
+  if((r = proc->aring) == 0)
+    return -1;
+  if(min > NARING)
+    min = NARING;
+
+  acquire(&aringlock);
+  wakeup(r);
+  while((int)(r->cqtail - r->cqhead) < min && !proc->killed)
+    sleep((void*)&r->cqtail, &aringlock);
+  release(&aringlock);
+  return r->cqtail - r->cqhead;
+}
@@ -0,0 +1,41 @@
+// Asynchronous syscall ring, shared between a process and the
+// kernel.  The process fills submission entries and bumps sqtail;
+// a kernel worker thread running in the same process executes them
+// in order and posts completions at cqtail.  See aring.c.
+
+#define NARING 64          // entries in each ring; a power of two
+
+// Operations, with the meaning of the entry fields.
+#define AR_READ   1        // fd, addr: buffer, n: count
+#define AR_WRITE  2        // fd, addr: buffer, n: count
+#define AR_OPEN   3        // addr: path, omode
+#define AR_CLOSE  4        // fd
+#define AR_FSTAT  5        // fd, addr: struct stat
+
+// aring_setup flags
+#define AR_POLL   1        // worker polls for a while before sleeping
+
+struct sqe {
+  int op;                  // AR_*
+  int fd;
+  uint addr;
+  int n;
+  int omode;
+  uint tag;                // copied to the completion
+};
+
+struct cqe {
+  uint tag;
+  int res;                 // what the matching syscall would return
+};
+
+struct aring {
+  volatile uint sqhead;    // next entry the kernel will take
+  volatile uint sqtail;    // next entry the process will fill
+  volatile uint cqhead;    // next completion the process will take
+  volatile uint cqtail;    // next completion the kernel will post
+  uint flags;              // AR_POLL
+  volatile uint sleeping;  // worker is asleep; aring_enter to wake it
+  struct sqe sq[NARING];
+  struct cqe cq[NARING];
+};
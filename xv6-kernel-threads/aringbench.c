@@ -0,0 +1,154 @@
+// Async syscall ring benchmark: write the same small records to a
+// file with one write() per record, and then through an aring, and
+// compare the time taken and the number of traps.  The ring pass
+// also reads the file back with open/fstat/read/close on the ring
+// to check what it wrote.
+//
+// usage: aringbench [nrec]
+
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "user.h"
+#include "x86.h"
+#include "aring.h"
+
+#define RECSZ 16
+#define FILE  "aringbench.out"
+
+static struct aring ring;
+static char rec[RECSZ] = "0123456789abcde\n";
+static int nenter;
+static int nbad;
+
+// Take one completion, which must exist.
+static struct cqe
+reap(void)
+{
+  struct cqe c;
+
+  c = ring.cq[ring.cqhead % NARING];
+  ring.cqhead++;
+  return c;
+}
+
+// Wait for one completion and return its result.
+static int
+wait1(void)
+{
+  if(ring.cqtail == ring.cqhead){
+    nenter++;
+    aring_enter(1);
+  }
+  return reap().res;
+}
+
+// Queue an operation, reaping write completions if the ring is full.
+static void
+submit(int op, int fd, void *addr, int n, int omode)
+{
+  struct sqe *e;
+
+  while(ring.sqtail - ring.cqhead >= NARING){
+    if(wait1() != RECSZ)
+      nbad++;
+  }
+  e = &ring.sq[ring.sqtail % NARING];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint)addr;
+  e->n = n;
+  e->omode = omode;
+  e->tag = ring.sqtail;
+  __sync_synchronize();
+  ring.sqtail++;
+  __sync_synchronize();
+  if(ring.sleeping){
+    nenter++;
+    aring_enter(0);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, fd, t;
+  uint64 t0;
+  struct stat st;
+  char *buf;
+
+  n = 4000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0)
+    n = 1;
+
+  unlink(FILE);
+  t = uptime();
+  t0 = rdtsc();
+  if((fd = open(FILE, O_CREATE|O_WRONLY)) < 0){
+    printf(2, "aringbench: cannot create %s\n", FILE);
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    write(fd, rec, RECSZ);
+  close(fd);
+  printf(1, "write(): %d records, %d ticks, %d cycles/rec, %d traps\n",
+         n, uptime() - t, percall(rdtsc() - t0, n), n + 2);
+
+  unlink(FILE);
+  if(aring_setup(&ring, AR_POLL) < 0){
+    printf(2, "aringbench: aring_setup failed\n");
+    exit();
+  }
+  t = uptime();
+  t0 = rdtsc();
+  submit(AR_OPEN, 0, FILE, 0, O_CREATE|O_WRONLY);
+  if((fd = wait1()) < 0){
+    printf(2, "aringbench: ring open failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    submit(AR_WRITE, fd, rec, RECSZ, 0);
+  submit(AR_CLOSE, fd, 0, 0, 0);
+  while(ring.cqhead != ring.sqtail - 1){
+    if(wait1() != RECSZ)
+      nbad++;
+  }
+  if(wait1() != 0)
+    nbad++;
+  printf(1, "aring:   %d records, %d ticks, %d cycles/rec, %d traps\n",
+         n, uptime() - t, percall(rdtsc() - t0, n), nenter + 1);
+
+  // Read it back through the ring.
+  submit(AR_OPEN, 0, FILE, 0, O_RDONLY);
+  if((fd = wait1()) < 0){
+    printf(2, "aringbench: ring reopen failed\n");
+    exit();
+  }
+  submit(AR_FSTAT, fd, &st, 0, 0);
+  if(wait1() < 0 || st.size != n*RECSZ){
+    printf(2, "aringbench: size %d, want %d\n", st.size, n*RECSZ);
+    nbad++;
+  }
+  buf = malloc(n*RECSZ);
+  submit(AR_READ, fd, buf, n*RECSZ, 0);
+  if(wait1() != n*RECSZ)
+    nbad++;
+  else
+    for(i = 0; i < n*RECSZ; i++)
+      if(buf[i] != rec[i % RECSZ]){
+        nbad++;
+        break;
+      }
+  submit(AR_CLOSE, fd, 0, 0, 0);
+  if(wait1() != 0)
+    nbad++;
+  unlink(FILE);
+
+  if(nbad)
+    printf(1, "aringbench: %d failures\n", nbad);
+  else
+    printf(1, "aringbench: ok\n");
+  exit();
+}
@@ -0,0 +1,83 @@
+// Syscall batching benchmark: open, fstat, read and close a file
+// with four traps per round, and then with one syscall_batch()
+// per round, and compare cycles per round.
+//
+// The batch has to name the descriptor open will return before it
+// runs; with 0, 1 and 2 taken that is 3, since open always picks
+// the lowest free descriptor.
+//
+// usage: batchbench [rounds] [file]
+
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "user.h"
+#include "x86.h"
+#include "syscall.h"
+#include "sysreq.h"
+
+#define FD 3
+
+static char buf[512];
+
+static void
+req(struct sysreq *r, int num, int a0, int a1, int a2, int flags)
+{
+  r->num = num;
+  r->arg[0] = a0;
+  r->arg[1] = a1;
+  r->arg[2] = a2;
+  r->flags = flags;
+  r->ret = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysreq r[4];
+  struct stat st;
+  char *path;
+  int i, n, fd, bad;
+  uint64 t0;
+
+  n = 2000;
+  path = "README";
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    path = argv[2];
+  if(n <= 0)
+    n = 1;
+
+  bad = 0;
+  t0 = rdtsc();
+  for(i = 0; i < n; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(2, "batchbench: cannot open %s\n", path);
+      exit();
+    }
+    if(fstat(fd, &st) < 0 || read(fd, buf, sizeof(buf)) < 0)
+      bad++;
+    close(fd);
+  }
+  printf(1, "separate: %d cycles/round\n", percall(rdtsc() - t0, n));
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++){
+    req(&r[0], SYS_open, (int)path, O_RDONLY, 0, SR_STOP);
+    req(&r[1], SYS_fstat, FD, (int)&st, 0, 0);
+    req(&r[2], SYS_read, FD, (int)buf, sizeof(buf), 0);
+    req(&r[3], SYS_close, FD, 0, 0, 0);
+    if(syscall_batch(r, 4) != 4 || r[0].ret != FD){
+      printf(2, "batchbench: batch open of %s failed\n", path);
+      exit();
+    }
+    if(r[1].ret < 0 || r[2].ret < 0 || r[3].ret < 0)
+      bad++;
+  }
+  printf(1, "batched:  %d cycles/round\n", percall(rdtsc() - t0, n));
+
+  if(bad)
+    printf(1, "batchbench: %d failed rounds\n", bad);
+  exit();
+}
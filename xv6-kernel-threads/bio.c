@@ -41,7 +41,7 @@ binit(void)
 {
   struct buf *b;
 
-  initlock(&bcache.lock, "bcache");
+  initmcslock(&bcache.lock, "bcache");
 
 //PAGEBREAK!
   // Create linked list of buffers
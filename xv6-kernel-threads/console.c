@@ -186,13 +186,32 @@ struct {
 
 #define C(x)  ((x)-'@')  // Control-x
 
-void
-consoleintr(int (*getc)(void))
+// Characters taken from the device by consoleintr()
+// that consoledo() has not yet processed.
+static struct {
+  struct spinlock lock;
+  char buf[INPUT_BUF];
+  uint r;  // Read index
+  uint w;  // Write index
+} rawin;
+
+// Line editing and echo for characters queued by consoleintr().
+// Deferred from the interrupt handler; see defer.c.
+static void
+consoledo(void *unused)
 {
   int c, doprocdump = 0;
 
   acquire(&cons.lock);
-  while((c = getc()) >= 0){
+  for(;;){
+    acquire(&rawin.lock);
+    if(rawin.r == rawin.w){
+      release(&rawin.lock);
+      break;
+    }
+    c = rawin.buf[rawin.r++ % INPUT_BUF];
+    release(&rawin.lock);
+
     switch(c){
     case C('P'):  // Process listing.
       // procdump() locks cons.lock indirectly; invoke later
@@ -230,6 +249,22 @@ consoleintr(int (*getc)(void))
   }
 }
 
+// Interrupt handler for keyboard and serial input.  Only drains
+// the device; echo and line editing run later in consoledo().
+void
+consoleintr(int (*getc)(void))
+{
+  int c;
+
+  acquire(&rawin.lock);
+  while((c = getc()) >= 0){
+    if(rawin.w - rawin.r < INPUT_BUF)
+      rawin.buf[rawin.w++ % INPUT_BUF] = c;
+  }
+  release(&rawin.lock);
+  defer(consoledo, 0);
+}
+
 int
 consoleread(struct inode *ip, char *dst, int n)
 {
@@ -287,6 +322,7 @@ void
 consoleinit(void)
 {
   initlock(&cons.lock, "console");
+  initlock(&rawin.lock, "rawin");
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
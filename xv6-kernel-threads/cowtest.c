@@ -1,41 +1,111 @@
+// Copy-on-write fork test.  Checks that parent and child each see
+// only their own writes to memory they shared at fork, including
+// writes the kernel makes on the child's behalf (read() into a
+// shared buffer), then times fork() against process size.
+//
+// usage: cowtest [maxmb]
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 #include "x86.h"
 
-void testCase1();
-void testCase2();
-void testCase3();
+#define NBUF (4*4096 + 1)   // spans five pages
+
+static void
+sharetest(void)
+{
+  char *buf;
+  int fd[2], i, ok;
+
+  buf = malloc(NBUF);
+  for(i = 0; i < NBUF; i++)
+    buf[i] = i;
+  if(pipe(fd) < 0){
+    printf(2, "cowtest: pipe failed\n");
+    exit();
+  }
+
+  if(fork() == 0){
+    // Child: write every byte, then let read() write some more.
+    ok = 1;
+    for(i = 0; i < NBUF; i++)
+      if(buf[i] != (char)i)
+        ok = 0;
+    for(i = 0; i < NBUF; i++)
+      buf[i] = ~i;
+    if(read(fd[0], buf + 4096, 5) != 5 || buf[4096] != 'p')
+      ok = 0;
+    for(i = 0; i < NBUF; i++)
+      if(i < 4096 || i >= 4096+5)
+        if(buf[i] != (char)~i)
+          ok = 0;
+    write(fd[1], &ok, sizeof(ok));
+    exit();
+  }
+
+  // Parent: its writes must not reach the child, nor the child's it.
+  buf[1] = 'x';
+  write(fd[1], "prnt", 5);
+  wait();
+  if(read(fd[0], &ok, sizeof(ok)) != sizeof(ok))
+    ok = 0;
+  check("child view", ok);
+  ok = buf[1] == 'x';
+  for(i = 2; i < NBUF; i++)
+    if(buf[i] != (char)i)
+      ok = 0;
+  check("parent view", ok);
+  close(fd[0]);
+  close(fd[1]);
+  free(buf);
+}
 
-int main()
+// Grow by mb megabytes, touch every page, and time fork+exit+wait.
+static void
+forktime(int mb)
 {
-	int pid, i;
-	// make sure we we'll change two pages.
-	int SIZE = 4096 + 1;
-	char *space = (char *)malloc(SIZE);
-	printf(1,"cow test.\n");
-
-	procdump();
-    // son
-	if((pid = fork())==0)
-	{
-		printf(1,"\nChild process before changing values\n\n");
-		procdump();
-		for(i = 0; i < SIZE; i++)
-		{
-			// writing to heap
-			space[i]++;
-		}
-		printf(1,"\nChild process after changing values\n\n");
-		procdump();
-		exit();	
-	}
-	// parent
-	else
-		wait();
-
-	free(space);
-	exit();
-
-return 1;
-}
\ No newline at end of file
+  char *p;
+  int i, n, pid;
+  uint64 t0;
+
+  n = mb*1024*1024;
+  if((p = sbrk(n)) == (char*)-1){
+    printf(1, "%d MB: sbrk failed\n", mb);
+    return;
+  }
+  for(i = 0; i < n; i += 4096)
+    p[i] = i;
+
+  t0 = rdtsc();
+  for(i = 0; i < 10; i++){
+    if((pid = fork()) == 0)
+      exit();
+    if(pid < 0){
+      printf(1, "%d MB: fork failed\n", mb);
+      break;
+    }
+    wait();
+  }
+  if(i == 10)
+    printf(1, "%d MB: fork+exit+wait %d cycles\n", mb, percall(rdtsc() - t0, 10));
+  sbrk(-n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, max;
+
+  max = 16;
+  if(argc > 1)
+    max = atoi(argv[1]);
+
+  sharetest();
+  if(checkfails() == 0)
+    printf(1, "cowtest: ok\n");
+  forktime(0);
+  for(mb = 1; mb <= max; mb *= 2)
+    forktime(mb);
+  exit();
+}
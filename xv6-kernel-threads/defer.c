@@ -0,0 +1,80 @@
+// Deferred interrupt work ("bottom halves").
+//
+// A device interrupt handler should only do what cannot wait:
+// acknowledge the device and pull out data that would otherwise
+// be lost.  Anything slower (copying a disk block, echoing to the
+// console, waking sleepers, starting the next request) is handed
+// to defer(), which queues it on this CPU.  trap() calls rundefer()
+// once the handler has sent its EOI, and rundefer() runs the queue
+// with interrupts enabled again, so other devices are serviced while
+// the deferred work runs.
+//
+// Deferred work runs on whatever stack the interrupt arrived on and
+// must not sleep.  While it runs, cpu->indefer is set: nested
+// interrupts only queue more work, and trap() does not yield, so
+// the queue is drained by the CPU that owns it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+
+#define NDEFER 32
+
+struct deferred {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static struct {
+  struct deferred q[NDEFER];
+  uint head;                   // Next entry to run
+  uint tail;                   // Next free entry
+} defers[NCPU];
+
+// Queue fn(arg) to run on this CPU when the interrupt handler
+// returns.  Call only from interrupt handlers.
+void
+defer(void (*fn)(void*), void *arg)
+{
+  struct deferred *d;
+
+  pushcli();
+  if(defers[cpu-cpus].tail - defers[cpu-cpus].head == NDEFER){
+    // Queue full; fall back to doing the work right now.
+    popcli();
+    fn(arg);
+    return;
+  }
+  d = &defers[cpu-cpus].q[defers[cpu-cpus].tail++ % NDEFER];
+  d->fn = fn;
+  d->arg = arg;
+  popcli();
+}
+
+// Run this CPU's deferred work.  Called by trap() with interrupts
+// off; turns them on around each item.
+void
+rundefer(void)
+{
+  struct deferred d;
+  int c;
+
+  if(cpu->indefer || cpu->ncli > 0)
+    return;
+  c = cpu - cpus;
+  if(defers[c].head == defers[c].tail)
+    return;
+
+  cpu->indefer = 1;
+  while(defers[c].head != defers[c].tail){
+    d = defers[c].q[defers[c].head++ % NDEFER];
+    sti();
+    d.fn(d.arg);
+    cli();
+  }
+  cpu->indefer = 0;
+}
@@ -1,13 +1,32 @@
+struct aring;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
+struct lockstat;
 struct pipe;
+struct profsample;
 struct proc;
 struct rtcdate;
+struct scstat;
+struct shm;
 struct spinlock;
 struct stat;
+struct straceent;
 struct superblock;
+struct traceevent;
+struct vma;
+struct vproc;
+struct threadstat;
+struct trapframe;
+
+// aring.c
+void            aringinit(void);
+int             aringsetup(struct aring*, int);
+void            aringstop(void);
+int             aringpinned(uint, uint);
+int             aringenter(int);
 
 // bio.c
 void            binit(void);
@@ -21,6 +40,10 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// defer.c
+void            defer(void (*)(void*), void*);
+void            rundefer(void);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -65,6 +88,15 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+char*           kalloc_pages(int);
+char*           kalloc_zeroed(void);
+void            kzeroinit(void);
+void            kdup(char*);
+int             krefs(char*);
+void            kfree_pages(char*, int);
+void            kfree_defer(char*, uint*);
+void            kfreelist(uint);
+int             kallocbench(int, int);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -77,6 +109,7 @@ int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -95,24 +128,40 @@ void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
+// kprof.c
+void            profinit(void);
+void            profsample(struct trapframe*);
+int             profread(struct profsample*, int);
+
 // proc.c
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+void            tlbshootdown(struct proc*);
+void            tlbshootdown_nowait(struct proc*);
 int             kill(int);
+int             kthread_run(void (*)(void*), void*);
+int             kthread_run_proc(void (*)(void*), void*);
+void            kthread_wait_proc(int);
 void            kill_others(void);
 void            kill_all(void);
 void            pinit(void);
 void            procdump(void);
+int             profctl(int, int);
+int             procscstats(int, struct scstat*, int, int);
+int             stracectl(int, int);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+int             threadstats(struct threadstat*, int);
+int             runlatstats(uint*, int, int);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
@@ -122,11 +171,37 @@ void 			killSelf(void);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmcreate(int, uint);
+struct shm*     shmget(int);
+void            shmdup(struct shm*);
+void            shmput(struct shm*);
+uint            shmsize(struct shm*);
+char*           shmpage(struct shm*, uint);
+int             shmremove(int);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint, void (*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabdump(void);
+
+// text.c
+void            textinit(void);
+char*           textget(struct inode*, uint, uint);
+struct inode*   textput(struct inode*, uint, uint, char*);
+void            textinval(struct inode*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initmcslock(struct spinlock*, char*);
+int             lockbench(int, int);
+int             lockstats(struct lockstat*, int, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -146,12 +221,26 @@ int             argptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
+void            scstatinit(void);
+int             scstats(struct scstat*, int, int);
+int             straceread(struct straceent*, int);
 void            syscall(void);
 
+// sysfile.c
+int             closefd(int);
+int             openfd(char*, int);
+
 // timer.c
 void            timerinit(void);
 
+// trace.c
+void            traceinit(void);
+void            trace(int, uint, uint);
+int             tracectl(int);
+int             traceread(struct traceevent*, int);
+
 // trap.c
+void            systrap(struct trapframe*);
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
@@ -162,17 +251,34 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// vdso.c
+extern char     vdsopage[];
+void            vdsotick(void);
+void            vprocfill(struct proc*);
+
 // vm.c
+struct vproc*   allocvproc(pde_t*);
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             deallocuvm_defer(pde_t*, uint, uint, uint*);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, struct vma*);
+int             pageFault(struct trapframe*);
+int             vmprefault(uint, uint);
+int             vmfillshared(void);
+int             uservalid(uint, uint);
+uint            userend(uint);
+void            freevmas(struct vma*);
+void            copyvmas(struct vma*, struct vma*);
+uint            mmap(uint, int, int, struct inode*, uint, uint);
+int             munmap(uint, uint);
+uint            shmattach(int);
+int             shmdetach(uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
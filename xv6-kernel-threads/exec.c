@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "vdso.h"
 
 int
 exec(char *path, char **argv)
@@ -17,7 +18,12 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct vproc *vproc;
+  struct vma vma[NVMA], tmp;
+  int nvma;
 
+  memset(vma, 0, sizeof(vma));
+  nvma = 0;
   begin_op();
   if((ip = namei(path)) == 0){
     end_op();
@@ -34,8 +40,12 @@ exec(char *path, char **argv)
 
   if((pgdir = setupkvm()) == 0)
     goto bad;
+  if((vproc = allocvproc(pgdir)) == 0)
+    goto bad;
 
-  // Load program into memory.
+  // Record where each program segment comes from in the file.
+  // Nothing is read yet: pageFault() brings pages in from the
+  // inode as the program touches them.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -44,22 +54,25 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > MMAPBASE)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nvma == NVMA)
       goto bad;
+    vma[nvma].start = ph.vaddr;
+    vma[nvma].end = PGROUNDUP(ph.vaddr + ph.memsz);
+    vma[nvma].ip = idup(ip);
+    vma[nvma].off = ph.off;
+    vma[nvma].filesz = ph.filesz;
+    vma[nvma].flags = (ph.flags & ELF_PROG_FLAG_WRITE) ? VMA_WRITE : 0;
+    sz = vma[nvma++].end;
   }
 
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  kill_others();  
-  
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
   sz = PGROUNDUP(sz);
@@ -93,14 +106,33 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(proc->name, last, sizeof(proc->name));
 
+  // Nothing can fail from here on.  Stop the ring worker, which
+  // uses the old image, before the other threads go.
+  aringstop();
+  kill_others();
+  munmap(MMAPBASE, USERTOP - MMAPBASE);   // write back shared mappings
+
   // Commit to the user image.
+  acquire(&proc->vmlock);
   oldpgdir = proc->pgdir;
   proc->pgdir = pgdir;
   proc->sz = sz;
+  for(i = 0; i < NVMA; i++){
+    tmp = proc->vma[i];
+    proc->vma[i] = vma[i];
+    vma[i] = tmp;
+  }
+  release(&proc->vmlock);
+  proc->vproc = vproc;
+  vprocfill(proc);
   thread->tf->eip = elf.entry;  // main
   thread->tf->esp = sp;
+  thread->tf->fs = (SEG_UTLS << 3) | DPL_USER;
   switchuvm(proc);
   freevm(oldpgdir);
+  begin_op();
+  freevmas(vma);   // now the old ones
+  end_op();
   return 0;
 
  bad:
@@ -110,5 +142,8 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  begin_op();
+  freevmas(vma);
+  end_op();
   return -1;
 }
\ No newline at end of file
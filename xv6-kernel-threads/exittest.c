@@ -0,0 +1,62 @@
+// Group exit test: a process with every thread slot spinning in
+// user space calls exit(), and the parent times how long wait()
+// takes to reap it.  Siblings on other CPUs are interrupted by an
+// IPI, so this should take well under a tick per round.
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kthread.h"
+
+#define NSPIN   15      // NTHREAD - 1
+#define ROUNDS  20
+#define STACK   1024
+
+volatile int started;
+
+void *
+spin(void)
+{
+  __sync_fetch_and_add(&started, 1);
+  for(;;)
+    ;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, r, pid, t0, total, worst, dt;
+
+  total = 0;
+  worst = 0;
+  for(r = 0; r < ROUNDS; r++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "exittest: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(i = 0; i < NSPIN; i++)
+        if(kthread_create(spin, malloc(STACK), STACK) < 0)
+          break;
+      while(started < i)
+        ;
+      exit();
+    }
+    // Only start the clock once the child is about to exit; the
+    // spinners going live is not what we are measuring.
+    sleep(5);
+    t0 = uptime();
+    if(wait() != pid){
+      printf(1, "exittest: wait failed\n");
+      exit();
+    }
+    dt = uptime() - t0;
+    total += dt;
+    if(dt > worst)
+      worst = dt;
+  }
+  printf(1, "exittest: %d rounds of %d spinners, %d ticks total, worst %d\n",
+         ROUNDS, NSPIN, total, worst);
+  exit();
+}
@@ -22,6 +22,8 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+  struct inode *next; // icache list, under icache.lock
+  int text;           // Has pages in the text cache; see text.c
 };
 #define I_BUSY 0x1
 #define I_VALID 0x2
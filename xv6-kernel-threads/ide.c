@@ -11,6 +11,7 @@
 #include "spinlock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -31,6 +32,7 @@ static struct spinlock idelock;
 static struct buf *idequeue;
 
 static int havedisk1;
+static int idecopying;   // idedone() is reading the active request
 static void idestart(struct buf*);
 
 // Wait for IDE disk to become ready.
@@ -84,6 +86,8 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
+  trace(TR_IDE_START, b->blockno, (b->flags & B_DIRTY) != 0);
+
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
   outb(0x1f2, sector_per_block);  // number of sectors
@@ -99,26 +103,36 @@ idestart(struct buf *b)
   }
 }
 
-// Interrupt handler.
-void
-ideintr(void)
+// Finish the active request and start the next one.
+// Deferred from ideintr(); see defer.c.
+static void
+idedone(void *unused)
 {
   struct buf *b;
 
   // First queued buffer is the active request.
   acquire(&idelock);
-  if((b = idequeue) == 0){
+  if((b = idequeue) == 0 || idecopying){
     release(&idelock);
     // cprintf("spurious IDE interrupt\n");
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  // Read data if needed.  b stays at the head of the queue, so
+  // iderw() will not start another request, and the copy can run
+  // without idelock and with interrupts on.
+  if(!(b->flags & B_DIRTY)){
+    idecopying = 1;
+    release(&idelock);
+    if(idewait(1) >= 0)
+      insl(0x1f0, b->data, BSIZE/4);
+    acquire(&idelock);
+    idecopying = 0;
+  }
+  idequeue = b->qnext;
 
   // Wake process waiting for this buf.
+  trace(TR_IDE_DONE, b->blockno, 0);
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
   wakeup(b);
@@ -130,6 +144,16 @@ ideintr(void)
   release(&idelock);
 }
 
+// Interrupt handler.  Reading the status register acknowledges
+// the interrupt; the controller holds the sector data until
+// idedone() copies it out, so the rest can wait.
+void
+ideintr(void)
+{
+  inb(0x1f7);
+  defer(idedone, 0);
+}
+
 //PAGEBREAK!
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
@@ -1,27 +1,83 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and runs of
+// 2^order physically contiguous pages for larger buffers.
+//
+// Underneath is a binary buddy allocator: free memory is kept as
+// blocks of 2^k pages, k <= MAXORDER, each aligned to its size,
+// on one list per order.  kalloc_pages() splits the smallest block
+// that fits, and kfree_pages() merges a block with its buddy (the
+// other half of the block of the next order up) for as long as the
+// buddy is free too.  The order field of each page's struct page
+// (page.h) marks which pages head a free block, and of what order,
+// so the buddy check is one lookup.
+//
+// Pages are reference counted so that page tables can share them
+// copy-on-write: kfree() only releases a page when its count drops
+// to zero.
+//
+// Single pages go through per-CPU magazines in front of the buddy
+// lists.  Each CPU keeps up to NMAG free pages that it allocates
+// from and frees to with interrupts off and no lock.  Only when its
+// magazine runs empty or overflows does a CPU take kmem.lock, and
+// then it moves MAGBATCH pages at once.  Pages parked in magazines
+// cannot merge; kalloc_pages() drains its own CPU's magazine before
+// giving up, but kalloc() can still fail with up to ncpu*NMAG
+// pages free on other CPUs.
+//
+// Most callers want zeroed pages (page tables, user memory), so a
+// kernel thread keeps a pool of up to NZERO pages zeroed ahead of
+// time, topping it up once a tick and yielding between pages, but
+// only while more than ZLOW pages are free.  kalloc_zeroed() takes
+// from the pool and zeroes a page itself only when the pool is
+// empty, and kalloc() falls back on the pool before failing.  Freed pages are filled with junk
+// to catch dangling references only if the kernel is built with
+// -DKJUNK, since every page gets written again before use anyway.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
+#include "page.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;   // only on the buddy lists
 };
 
+#define MAXORDER  10   // largest block is 2^MAXORDER pages (4MB)
+#define NMAG      32   // most pages a CPU keeps for itself
+#define MAGBATCH  16   // pages moved to or from the buddy lists at once
+#define NZERO     64   // pages kept zeroed ahead of time
+#define ZLOW      256  // free pages below which the pool is left alone
+
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run *free[MAXORDER+1];  // free blocks of each order
+  uint nfree;                    // pages on the buddy lists
 } kmem;
 
+struct page pages[NPAGE];
+
+// Per-CPU magazines, a cache line each so CPUs do not share.
+static struct mag {
+  struct run *list;
+  int n;
+} __attribute__((aligned(64))) mags[NCPU];
+
+static struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -30,7 +86,8 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
-  initlock(&kmem.lock, "kmem");
+  initmcslock(&kmem.lock, "kmem");
+  initlock(&zpool.lock, "zpool");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -47,8 +104,163 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    va2page(p)->ref = 1;
     kfree(p);
+  }
+}
+
+// Buddy list operations.  The caller holds kmem.lock, or is
+// booting on one CPU.
+static void
+bpush(struct run *r, int k)
+{
+  r->prev = 0;
+  r->next = kmem.free[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[k] = r;
+  va2page(r)->order = k+1;
+}
+
+static void
+bremove(struct run *r, int k)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  va2page(r)->order = 0;
+}
+
+// Take a block of 2^k pages, splitting a larger one if needed.
+static struct run*
+balloc(int k)
+{
+  struct run *r;
+  int j;
+
+  for(j = k; j <= MAXORDER && kmem.free[j] == 0; j++)
+    ;
+  if(j > MAXORDER)
+    return 0;
+  r = kmem.free[j];
+  bremove(r, j);
+  kmem.nfree -= 1<<k;
+  // Give back the upper halves until the block is the right size.
+  while(j > k){
+    j--;
+    bpush((struct run*)((char*)r + (PGSIZE<<j)), j);
+  }
+  return r;
+}
+
+// Return a block of 2^k pages, merging it with free buddies.
+static void
+bfree(struct run *r, int k)
+{
+  uint pn, bn;
+
+  pn = V2P(r)/PGSIZE;
+  if(pages[pn].order)
+    panic("kfree: double free");
+  kmem.nfree += 1<<k;
+  while(k < MAXORDER){
+    bn = pn ^ (1<<k);
+    if(bn >= NPAGE || pages[bn].order != k+1)
+      break;
+    bremove((struct run*)P2V(bn*PGSIZE), k);
+    pn &= ~(1<<k);
+    k++;
+  }
+  bpush((struct run*)P2V(pn*PGSIZE), k);
+}
+
+// Put this CPU's magazine back on the buddy lists so its pages
+// can merge again.
+static void
+magdrain(void)
+{
+  struct mag *m;
+  struct run *r;
+
+  pushcli();
+  m = &mags[cpu-cpus];
+  acquire(&kmem.lock);
+  while((r = m->list) != 0){
+    m->list = r->next;
+    bfree(r, 0);
+  }
+  m->n = 0;
+  release(&kmem.lock);
+  popcli();
+}
+
+// Drop a reference to the page (or block head) at v.
+// Returns 1 if that was the last one and v should be freed.
+static int
+kput(char *v)
+{
+  int n;
+
+  if((n = __sync_sub_and_fetch(&va2page(v)->ref, 1)) < 0)
+    panic("kfree: ref");
+  return n == 0;
+}
+
+// Add a reference to the page at v, which must be allocated.
+void
+kdup(char *v)
+{
+  if(__sync_fetch_and_add(&va2page(v)->ref, 1) < 1)
+    panic("kdup");
+}
+
+// Number of references to the page at v.
+int
+krefs(char *v)
+{
+  return va2page(v)->ref;
+}
+
+// Release the page at v, whose last reference is gone.
+static void
+kfreepage(char *v)
+{
+  struct run *r;
+  struct mag *m;
+  int i;
+
+#ifdef KJUNK
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE);
+#endif
+
+  r = (struct run*)v;
+  if(!kmem.use_lock){
+    // Booting: one CPU, and cpu is not set up yet.
+    bfree(r, 0);
+    return;
+  }
+
+  pushcli();
+  m = &mags[cpu-cpus];
+  r->next = m->list;
+  m->list = r;
+  if(++m->n > NMAG){
+    // Overflow: hand a batch back to the buddy lists.
+    acquire(&kmem.lock);
+    for(i = 0; i < MAGBATCH; i++){
+      r = m->list;
+      m->list = r->next;
+      bfree(r, 0);
+    }
+    release(&kmem.lock);
+    m->n -= MAGBATCH;
+  }
+  popcli();
 }
 
 //PAGEBREAK: 21
@@ -56,24 +268,41 @@ freerange(void *vstart, void *vend)
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// If the page is shared, only drop this reference.
 void
 kfree(char *v)
 {
-  struct run *r;
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kfree");
+  if(kput(v))
+    kfreepage(v);
+}
 
+// Like kfree(), but if that was the last reference, add the page to
+// *list instead of freeing it.  For pages just unmapped that another
+// CPU's TLB may still reach: free the list with kfreelist() once the
+// TLBs are flushed.  *list starts as 0.
+void
+kfree_defer(char *v, uint *list)
+{
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  if(kput(v)){
+    va2page(v)->next = *list;
+    *list = V2P(v)/PGSIZE;
+  }
+}
 
-  // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+// Free the pages on a list built by kfree_defer().
+void
+kfreelist(uint list)
+{
+  uint pn;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  while((pn = list) != 0){
+    list = pages[pn].next;
+    kfreepage(P2V(pn*PGSIZE));
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -83,14 +312,231 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct mag *m;
+
+  if(!kmem.use_lock){
+    if((r = balloc(0)) != 0)
+      va2page(r)->ref = 1;
+    return (char*)r;
+  }
+
+  pushcli();
+  m = &mags[cpu-cpus];
+  if(m->n == 0){
+    // Empty: refill a batch from the buddy lists.
+    acquire(&kmem.lock);
+    while(m->n < MAGBATCH && (r = balloc(0)) != 0){
+      r->next = m->list;
+      m->list = r;
+      m->n++;
+    }
+    release(&kmem.lock);
+  }
+  r = m->list;
+  if(r){
+    m->list = r->next;
+    m->n--;
+    va2page(r)->ref = 1;
+  }
+  popcli();
+  if(r == 0){
+    // Out of memory: use a page zeroed ahead of time, if any.
+    acquire(&zpool.lock);
+    if((r = zpool.list) != 0){
+      zpool.list = r->next;
+      zpool.n--;
+    }
+    release(&zpool.lock);
+  }
+  return (char*)r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size.  Returns 0 if no such run is free.
+char*
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
+  r = balloc(order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  if(r == 0 && kmem.use_lock){
+    // Our magazine may hold the missing buddies.
+    magdrain();
+    acquire(&kmem.lock);
+    r = balloc(order);
+    release(&kmem.lock);
+  }
   if(r)
-    kmem.freelist = r->next;
+    va2page(r)->ref = 1;
+  return (char*)r;
+}
+
+// Free 2^order pages returned by kalloc_pages(order).
+void
+kfree_pages(char *v, int order)
+{
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+  if(order < 0 || order > MAXORDER || V2P(v) % (PGSIZE<<order) ||
+     v < end || V2P(v) + (PGSIZE<<order) > PHYSTOP)
+    panic("kfree_pages");
+  if(!kput(v))
+    return;
+
+#ifdef KJUNK
+  memset(v, 1, PGSIZE<<order);
+#endif
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  bfree((struct run*)v, order);
   if(kmem.use_lock)
     release(&kmem.lock);
+}
+
+// Allocate one page of zeroed memory.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  if((r = zpool.list) != 0){
+    zpool.list = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+  if(r){
+    r->next = 0;   // the only non-zero word
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Body of the zeroing thread: keep the pool full, one page at a
+// time so that it gives way to anything else that wants the CPU.
+// When memory runs low it stops, so that the pool does not hold
+// pages that kalloc() would otherwise have to take back.
+static void
+zerowork(void *arg)
+{
+  struct run *r;
+
+  for(;;){
+    if(zpool.n >= NZERO || kmem.nfree < ZLOW ||
+       (r = (struct run*)kalloc()) == 0){
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+      continue;
+    }
+    memset(r, 0, PGSIZE);
+    acquire(&zpool.lock);
+    r->next = zpool.list;
+    zpool.list = r;
+    zpool.n++;
+    release(&zpool.lock);
+    yield();
+  }
+}
+
+// Start the zeroing thread.  Called by main() once all of memory
+// is on the free lists.
+void
+kzeroinit(void)
+{
+  if(kthread_run(zerowork, 0) < 0)
+    panic("kzeroinit");
+}
+
+// Number of free blocks of order k.
+static int
+nblocks(int k)
+{
+  struct run *r;
+  int n;
+
+  n = 0;
+  acquire(&kmem.lock);
+  for(r = kmem.free[k]; r; r = r->next)
+    n++;
+  release(&kmem.lock);
+  return n;
+}
+
+// Each round takes one block of every order below MAXORDER and
+// frees them odd orders first, so buddies come back out of order,
+// then drains the magazine the order-0 page went through.  All of
+// it should merge again: fail if there end up fewer free blocks of
+// MAXORDER than at the start.  Only meaningful on an idle system.
+static int
+buddybench(int nticks)
+{
+  char *pg[MAXORDER];
+  uint t0;
+  int k, n, before;
+
+  magdrain();
+  before = nblocks(MAXORDER);
+  n = 0;
+  t0 = ticks;
+  while(ticks - t0 < nticks){
+    pushcli();   // stay on this CPU, and so with its magazine
+    for(k = 0; k < MAXORDER; k++)
+      if((pg[k] = kalloc_pages(k)) != 0)
+        n += 1<<k;
+    for(k = 1; k < MAXORDER; k += 2)
+      if(pg[k])
+        kfree_pages(pg[k], k);
+    for(k = 0; k < MAXORDER; k += 2)
+      if(pg[k])
+        kfree_pages(pg[k], k);
+    magdrain();
+    popcli();
+  }
+  if(nblocks(MAXORDER) < before)
+    return -1;
+  return n;
+}
+
+// Allocator microbenchmark used by the allocbench user program.
+// For nticks clock ticks, repeatedly allocate npages pages and
+// free them again, and return how many pages this caller got.
+// With npages 0, run buddybench instead.
+int
+kallocbench(int npages, int nticks)
+{
+  char *pg[NMAG*2];
+  uint t0;
+  int i, k, n;
+
+  if(npages < 0 || npages > NELEM(pg) || nticks <= 0)
+    return -1;
+  if(npages == 0)
+    return buddybench(nticks);
+  n = 0;
+  t0 = ticks;
+  while(ticks - t0 < nticks){
+    for(k = 0; k < npages; k++)
+      if((pg[k] = kalloc()) == 0)
+        break;
+    n += k;
+    for(i = 0; i < k; i++)
+      kfree(pg[i]);
+  }
+  return n;
+}
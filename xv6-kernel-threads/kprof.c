@@ -0,0 +1,93 @@
+// Timer-tick sampling profiler.
+//
+// When a process has profiling enabled (see profctl() in
+// proc.c), every timer
+// interrupt that lands on one of its threads records the
+// interrupted eip in the CPU's sample buffer.  Only the owning
+// CPU appends to a buffer, from the timer interrupt, so no lock
+// is needed there.  Both sides move n with cmpxchg: the appender
+// from i to i+1 once s[i] is written, and profread() from cnt to
+// 0 once it has copied s[0..cnt-1].  Whichever loses retries, so
+// a sample is neither lost nor read twice.  Samples arriving at a
+// full buffer are dropped and counted.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "prof.h"
+
+struct profbuf {
+  volatile uint n;             // Samples in s[]
+  uint dropped;                // Samples lost to a full buffer
+  struct profsample s[NPROF];
+};
+
+static struct profbuf profbufs[NCPU];
+static struct spinlock proflock;  // serializes readers
+
+void
+profinit(void)
+{
+  initlock(&proflock, "prof");
+}
+
+// Record a sample of the current thread.  Called from trap()
+// on a timer interrupt, with interrupts off.
+void
+profsample(struct trapframe *tf)
+{
+  struct profbuf *b;
+  struct profsample *s;
+  uint i;
+
+  b = &profbufs[cpu-cpus];
+  do {
+    // Start over if profread() emptied the buffer meanwhile.
+    if((i = b->n) >= NPROF){
+      b->dropped++;
+      return;
+    }
+    s = &b->s[i];
+    s->eip = tf->eip;
+    s->pid = proc->pid;
+    s->tid = thread->tid;
+    s->cpu = cpu-cpus;
+    s->user = (tf->cs&3) == DPL_USER;
+  } while(cmpxchg(&b->n, i, i+1) != i);
+}
+
+// Move samples from all CPUs into s, which has room for n.
+// A CPU's buffer is drained whole or not at all; samples that
+// do not fit stay for the next call.  Returns the number copied.
+int
+profread(struct profsample *s, int n)
+{
+  struct profbuf *b;
+  uint cnt;
+  int c, k;
+
+  k = 0;
+  acquire(&proflock);
+  for(c = 0; c < ncpu; c++){
+    b = &profbufs[c];
+    for(;;){
+      cnt = b->n;
+      if(cnt > n - k)
+        goto out;
+      memmove(s + k, b->s, cnt * sizeof(b->s[0]));
+      // Empty the buffer unless the CPU appended meanwhile, in
+      // which case copy the longer buffer again.
+      if(cmpxchg(&b->n, cnt, 0) == cnt)
+        break;
+    }
+    k += cnt;
+  }
+out:
+  release(&proflock);
+  return k;
+}
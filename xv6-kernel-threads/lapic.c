@@ -134,6 +134,18 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send a fixed-delivery interrupt with the given vector to one CPU.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
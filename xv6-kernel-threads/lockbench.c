@@ -0,0 +1,83 @@
+// Spinlock microbenchmark: run one process per CPU, each
+// hammering the same kernel lock for a fixed number of ticks,
+// and report total throughput and how fairly the lock was
+// shared between them.
+//
+// usage: lockbench [nproc] [ticks]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "spinlock.h"
+
+#define MAXPROC 16
+
+static char *names[] = {
+  [SPIN_TICKET] "ticket",
+  [SPIN_MCS]    "mcs",
+};
+
+void
+bench(int type, int nproc, int nticks)
+{
+  int fd[2], counts[MAXPROC];
+  int i, n, total, min, max;
+
+  if(pipe(fd) < 0){
+    printf(2, "lockbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      n = lockbench(type, nticks);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+
+  total = 0;
+  min = max = -1;
+  for(i = 0; i < nproc; i++){
+    if(read(fd[0], &n, sizeof(n)) != sizeof(n))
+      n = 0;
+    counts[i] = n;
+    total += n;
+    if(min < 0 || n < min)
+      min = n;
+    if(n > max)
+      max = n;
+  }
+  close(fd[0]);
+  for(i = 0; i < nproc; i++)
+    wait();
+
+  printf(1, "%s: %d acquires in %d ticks (%d/tick)\n",
+         names[type], total, nticks, total / nticks);
+  printf(1, "  per proc:");
+  for(i = 0; i < nproc; i++)
+    printf(1, " %d", counts[i]);
+  printf(1, "\n  fairness (min/max): %d%%\n", max > 0 ? min * 100 / max : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nticks;
+
+  nproc = 4;
+  nticks = 100;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nticks = atoi(argv[2]);
+  if(nproc < 1 || nproc > MAXPROC || nticks < 1){
+    printf(2, "usage: lockbench [nproc 1-%d] [ticks]\n", MAXPROC);
+    exit();
+  }
+
+  bench(SPIN_TICKET, nproc, nticks);
+  bench(SPIN_MCS, nproc, nticks);
+  exit();
+}
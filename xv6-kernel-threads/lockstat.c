@@ -0,0 +1,50 @@
+// Print kernel spinlocks sorted by total time spent waiting
+// for them.  With -r, reset the counters after reading.
+//
+// usage: lockstat [-r] [count]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+struct lockstat st[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, top, reset;
+  struct lockstat tmp;
+
+  reset = 0;
+  top = 10;
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-r") == 0)
+      reset = 1;
+    else
+      top = atoi(argv[i]);
+  }
+
+  if((n = lockstat(st, NLOCKSTAT, reset)) < 0){
+    printf(2, "lockstat: failed\n");
+    exit();
+  }
+
+  // Insertion sort by total wait time, largest first.
+  for(i = 1; i < n; i++){
+    tmp = st[i];
+    for(j = i; j > 0 && st[j-1].spinkcyc < tmp.spinkcyc; j--)
+      st[j] = st[j-1];
+    st[j] = tmp;
+  }
+
+  printf(1, "name            acquires  contended  wait(kcyc)  maxwait(cyc)  hold(kcyc)\n");
+  for(i = 0; i < n && i < top; i++){
+    printf(1, "%s", st[i].name);
+    for(j = strlen(st[i].name); j < 16; j++)
+      printf(1, " ");
+    printf(1, "%d  %d  %d  %d  %d\n", st[i].acquires, st[i].contended,
+           st[i].spinkcyc, st[i].maxspin, st[i].holdkcyc);
+  }
+  exit();
+}
@@ -0,0 +1,14 @@
+// Per-lock contention statistics, summed over all CPUs
+// and all locks sharing a name (e.g. every "pipe" lock).
+// Cycle counts come from rdtsc; totals are in units of
+// 1024 cycles so they fit in a uint.
+#define NLOCKSTAT 64   // maximum distinct lock names tracked
+
+struct lockstat {
+  char name[16];     // Name passed to initlock()
+  uint acquires;     // Times acquired
+  uint contended;    // Acquires that had to wait
+  uint spinkcyc;     // Total cycles spent waiting / 1024
+  uint maxspin;      // Longest single wait, in cycles
+  uint holdkcyc;     // Total cycles held / 1024
+};
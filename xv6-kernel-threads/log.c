@@ -4,6 +4,7 @@
 #include "spinlock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -190,11 +191,13 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    trace(TR_LOG_BEGIN, log.lh.n, 0);
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    trace(TR_LOG_END, 0, 0);
   }
 }
 
@@ -29,14 +29,23 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  traceinit();     // event tracing
+  profinit();      // sampling profiler
+  aringinit();     // async syscall rings
+  scstatinit();    // syscall statistics
   binit();         // buffer cache
+  slabinit();      // kernel object caches
   fileinit();      // file table
+  pipeinit();      // pipe cache
+  textinit();      // shared program pages
+  shminit();       // shared memory segments
   ideinit();       // disk
   if(!ismp)
     timerinit();   // uniprocessor timer
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  kzeroinit();     // pre-zeroed page pool
   mpmain();        // finish this processor's setup
 }
 
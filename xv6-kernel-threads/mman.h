@@ -0,0 +1,9 @@
+// mmap() protections and flags.
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+
+#define MAP_SHARED   0x1   // writes reach the file and forked children
+#define MAP_PRIVATE  0x2   // writes are copy-on-write
+#define MAP_ANON     0x4   // zero-filled, no file
+
+#define MAP_FAILED   ((void*)-1)
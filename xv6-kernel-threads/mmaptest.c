@@ -0,0 +1,180 @@
+// mmap() test.  Checks anonymous, private and shared file mappings,
+// a shared mapping across fork, and munmap punching a hole; then
+// times random 4-byte reads of a file through a mapping against
+// read() calls of the same size.  xv6 has no lseek, so the read()
+// side reads sequentially, which only flatters it.
+//
+// usage: mmaptest [naccess]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+#include "x86.h"
+
+#define FILESZ (16*4096)
+#define FNAME  "mmapfile"
+
+static void
+mkfile(void)
+{
+  int fd, i;
+  uint buf[128];
+
+  unlink(FNAME);
+  if((fd = open(FNAME, O_CREATE|O_RDWR)) < 0){
+    printf(2, "mmaptest: cannot create %s\n", FNAME);
+    exit();
+  }
+  for(i = 0; i < FILESZ/4; i++){
+    buf[i % 128] = i;
+    if(i % 128 == 127)
+      write(fd, buf, sizeof(buf));
+  }
+  close(fd);
+}
+
+static void
+anontest(void)
+{
+  char *p;
+  int i, ok;
+
+  p = mmap(0, 10*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  check("anon mmap", p != MAP_FAILED);
+  if(p == MAP_FAILED)
+    return;
+  ok = 1;
+  for(i = 0; i < 10*4096; i += 512)
+    if(p[i] != 0)
+      ok = 0;
+  for(i = 0; i < 10*4096; i++)
+    p[i] = i;
+  for(i = 0; i < 10*4096; i++)
+    if(p[i] != (char)i)
+      ok = 0;
+  check("anon contents", ok);
+
+  // Unmap the middle; both ends must survive.
+  check("munmap hole", munmap(p + 4*4096, 2*4096) == 0);
+  check("hole ends", p[4*4096 - 1] == (char)(4*4096 - 1) &&
+                     p[6*4096] == (char)(6*4096));
+  check("munmap rest", munmap(p, 4*4096) == 0 && munmap(p + 6*4096, 4*4096) == 0);
+}
+
+static void
+privatetest(void)
+{
+  uint *p, x;
+  int fd, i, ok;
+
+  fd = open(FNAME, O_RDONLY);
+  p = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);   // the mapping keeps the file
+  check("private mmap", p != MAP_FAILED);
+  if(p == MAP_FAILED)
+    return;
+  ok = 1;
+  for(i = 0; i < FILESZ/4; i++)
+    if(p[i] != i)
+      ok = 0;
+  check("private contents", ok);
+  p[5] = 0xdead;
+  munmap(p, FILESZ);
+
+  fd = open(FNAME, O_RDONLY);
+  check("private write stays private",
+        read(fd, &x, 4) == 4 && read(fd, &x, 4) == 4 && x == 1);
+  close(fd);
+}
+
+static void
+sharedtest(void)
+{
+  uint *p, x;
+  int fd, i;
+
+  fd = open(FNAME, O_RDWR);
+  p = mmap(0, FILESZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  check("shared mmap", p != MAP_FAILED);
+  if(p == MAP_FAILED)
+    return;
+
+  // The child's writes land in the parent's pages and, after
+  // munmap, in the file.
+  if(fork() == 0){
+    p[1] = 0xbeef;
+    exit();
+  }
+  wait();
+  check("shared across fork", p[1] == 0xbeef);
+  munmap(p, FILESZ);
+
+  fd = open(FNAME, O_RDONLY);
+  for(i = 0; i < 2; i++)
+    read(fd, &x, 4);
+  check("shared write reaches file", x == 0xbeef);
+  close(fd);
+}
+
+static void
+readtime(int naccess)
+{
+  uint *p, x, r, sum;
+  int fd, i;
+  uint64 t0;
+
+  fd = open(FNAME, O_RDONLY);
+  p = mmap(0, FILESZ, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmaptest: mmap failed\n");
+    close(fd);
+    return;
+  }
+  sum = 0;
+  r = 1;
+  t0 = rdtsc();
+  for(i = 0; i < naccess; i++){
+    r = r*1103515245 + 12345;
+    sum += p[(r >> 8) % (FILESZ/4)];
+  }
+  printf(1, "mmap: %d cycles per read\n", percall(rdtsc() - t0, naccess));
+  munmap(p, FILESZ);
+
+  t0 = rdtsc();
+  for(i = 0; i < naccess; i++){
+    if(read(fd, &x, 4) != 4){
+      close(fd);
+      fd = open(FNAME, O_RDONLY);
+      read(fd, &x, 4);
+    }
+    sum += x;
+  }
+  printf(1, "read(): %d cycles per read\n", percall(rdtsc() - t0, naccess));
+  close(fd);
+  if(sum == 1)
+    printf(1, "\n");   // keep sum live
+}
+
+int
+main(int argc, char *argv[])
+{
+  int naccess;
+
+  naccess = 100000;
+  if(argc > 1)
+    naccess = atoi(argv[1]);
+
+  mkfile();
+  anontest();
+  privatetest();
+  sharedtest();
+  if(checkfails() == 0)
+    printf(1, "mmaptest: ok\n");
+  mkfile();
+  readtime(naccess);
+  unlink(FNAME);
+  exit();
+}
@@ -42,13 +42,14 @@
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
-#define SEG_KCPU  3  // kernel per-cpu data
-#define SEG_UCODE 4  // user code
-#define SEG_UDATA 5  // user data+stack
+#define SEG_UCODE 3  // user code; sysexit wants it at SEG_KCODE+2
+#define SEG_UDATA 4  // user data+stack; and this at SEG_KCODE+3
+#define SEG_KCPU  5  // kernel per-cpu data
 #define SEG_TSS   6  // this process's task state
+#define SEG_UTLS  7  // user %fs: this thread's slot in VPROC
 
 // cpu->gdt[NSEGS] holds the above segments.
-#define NSEGS     7
+#define NSEGS     8
 
 //PAGEBREAK!
 #ifndef __ASSEMBLER__
@@ -146,6 +147,11 @@ struct segdesc {
 //#define PTE_MBZ         0x180   // Bits must be zero
 #define PTE_MBZ         0x200   // Bit must be zero
 
+// Page fault error code bits
+#define FEC_PR          0x1     // Page was present (protection fault)
+#define FEC_WR          0x2     // Fault was a write
+#define FEC_U           0x4     // Fault was in user mode
+
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
@@ -0,0 +1,74 @@
+// Null system call latency: time the getpid system call entered
+// through int $T_SYSCALL and through sysenter, the two paths usys.S
+// can take, and getpid() from ulib, which reads the VPROC page and
+// does not trap at all.  Reports average cycles per call.
+//
+// usage: nullsys [ncalls]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "traps.h"
+#include "syscall.h"
+
+extern int sysenter_ok;   // usys.S
+
+static int
+getpid_int(void)
+{
+  int r;
+
+  asm volatile("int %1" : "=a" (r) : "i" (T_SYSCALL), "a" (SYS_getpid) :
+               "memory");
+  return r;
+}
+
+static int
+getpid_sysenter(void)
+{
+  int r;
+
+  asm volatile("movl %%esp, %%ecx\n\t"
+               "movl $1f, %%edx\n\t"
+               "sysenter\n"
+               "1:" : "=a" (r) : "a" (SYS_getpid) : "ecx", "edx", "memory");
+  return r;
+}
+
+static void
+bench(char *name, int (*fn)(void), int n)
+{
+  int i, pid;
+  uint64 t0;
+
+  pid = getpid();
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    if(fn() != pid){
+      printf(1, "%s: wrong pid\n", name);
+      return;
+    }
+  printf(1, "%s: %d cycles/call\n", name, percall(rdtsc() - t0, n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0)
+    n = 1;
+
+  sleep(0);   // let usys.S find out whether sysenter works
+  bench("int $T_SYSCALL", getpid_int, n);
+  if(sysenter_ok > 0)
+    bench("sysenter", getpid_sysenter, n);
+  else
+    printf(1, "sysenter: not supported by this CPU\n");
+  bench("vproc page", getpid, n);
+  exit();
+}
@@ -0,0 +1,32 @@
+// Physical page descriptors, one for every page below PHYSTOP.
+//
+// ref counts the users of an allocated page: kalloc() returns it
+// with ref 1, kdup() adds a user (another page table mapping the
+// same page copy-on-write), and kfree() drops one, releasing the
+// page only when the last user is gone.  ref is updated with
+// atomic instructions and needs no lock.
+//
+// order is the buddy allocator's, guarded by kmem.lock: order+1
+// if the page heads a free block, else 0.
+//
+// next links a page whose last reference is gone but that another
+// CPU's TLB may still map onto its owner's list (kfree_defer), as
+// a page number; 0 ends the list.
+
+struct page {
+  int ref;
+  uchar order;
+  uchar flags;
+  ushort next;
+};
+
+#define PG_SLAB   0x1   // carved into objects by slab.c
+
+#define NPAGE       (PHYSTOP/PGSIZE)
+#if NPAGE > 0x10000
+#error "page numbers do not fit in struct page's next"
+#endif
+#define pa2page(pa) (&pages[(uint)(pa)/PGSIZE])
+#define va2page(va) pa2page(V2P(va))
+
+extern struct page pages[NPAGE];
@@ -8,6 +8,10 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "traps.h"
+#include "threadstat.h"
+#include "trace.h"
+#include "vdso.h"
 #include <stddef.h>
 
 
@@ -22,6 +26,7 @@ struct {
 
 
 static struct proc *initproc;
+static struct proc *kproc;     // holds the kernel-only threads
 
 bool pinit_called = false;
 int nextpid = 1;
@@ -32,10 +37,109 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+// Mark t runnable and note when, so that scheduler() can
+// record how long it waited for a CPU.
+// Must hold ptable.lock.
+static void
+setrunnable(struct thread *t)
+{
+  t->state = TRUNNABLE;
+  t->readytsc = rdtsc();
+}
+
+// Send an IPI to every other CPU running a thread of p, so that
+// the thread traps into the kernel and sees p->killed now.
+// Must hold ptable.lock.
+static void
+kickthreads(struct proc *p)
+{
+  struct thread *t;
+
+  for(t = p->threads; t < &p->threads[NTHREAD]; t++)
+    if(t != thread && t->state == TRUNNING && &cpus[t->lastcpu] != cpu)
+      lapicipi(cpus[t->lastcpu].apicid, T_IRQ0 + IRQ_IPI);
+}
+
+// Make the other CPUs running threads of p flush their TLBs, and
+// wait until they have.  Call after taking write access away from
+// pages p may be using.  Must not hold ptable.lock: a CPU spinning
+// for it with interrupts off would never take the IPI.
+void
+tlbshootdown(struct proc *p)
+{
+  struct thread *t;
+  uint gen[NCPU];
+  int want[NCPU];
+  int c;
+
+  memset(want, 0, sizeof(want));
+  acquire(&ptable.lock);
+  for(t = p->threads; t < &p->threads[NTHREAD]; t++){
+    c = t->lastcpu;
+    if(t != thread && t->state == TRUNNING && &cpus[c] != cpu && !want[c]){
+      want[c] = 1;
+      gen[c] = cpus[c].tlbgen;
+      lapicipi(cpus[c].apicid, T_IRQ0 + IRQ_IPI);
+    }
+  }
+  release(&ptable.lock);
+
+  for(c = 0; c < ncpu; c++)
+    if(want[c])
+      while(cpus[c].tlbgen == gen[c])
+        ;
+}
+
+// Like tlbshootdown, for callers that may hold spinlocks, including
+// ptable.lock: interrupt the other CPUs running threads of p without
+// waiting.  Each flushes when it next takes interrupts, which is
+// before it runs user code again.  The unlocked scan may send a
+// spare IPI; a thread it misses reloads %cr3 when it is switched in.
+void
+tlbshootdown_nowait(struct proc *p)
+{
+  struct thread *t;
+  int c;
+
+  for(t = p->threads; t < &p->threads[NTHREAD]; t++){
+    c = t->lastcpu;
+    if(t != thread && t->state == TRUNNING && &cpus[c] != cpu)
+      lapicipi(cpus[c].apicid, T_IRQ0 + IRQ_IPI);
+  }
+}
+
+// Count threads of p other than the caller that can still run.
+// Must hold ptable.lock.
+static int
+livethreads(struct proc *p)
+{
+  struct thread *t;
+  int n;
+
+  n = 0;
+  for(t = p->threads; t < &p->threads[NTHREAD]; t++)
+    if(t != thread && (t->state == TSLEEPING || t->state == TRUNNABLE ||
+                       t->state == TRUNNING))
+      n++;
+  return n;
+}
+
+// Add the wait of a thread that is about to run to this
+// CPU's log2 latency histogram.
+static void
+runlat_record(struct thread *t)
+{
+  cpu->runlat[log2bucket(rdtsc() - t->readytsc, NRUNLAT)]++;
+}
+
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  struct proc *p;
+
+  initmcslock(&ptable.lock, "ptable");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->vmlock, "vm");
   initlock(&mtable.lock, "mtable");
   init_mutexes();
 
@@ -83,7 +187,16 @@ allocthread(struct proc * p)
   t->tid = nexttid++;
   t->state = TEMBRYO;
   t->parent = p;
+  if(p->vproc)
+    p->vproc->tid[t - p->threads] = t->tid;
   t->killed = 0;
+  t->uticks = 0;
+  t->kticks = 0;
+  t->nvcsw = 0;
+  t->nivcsw = 0;
+  t->lastcpu = -1;
+  t->kfn = 0;
+  t->karg = 0;
 
   // Allocate kernel stack.
   if((t->kstack = kalloc()) == 0){
@@ -131,6 +244,15 @@ allocproc(void)
 found:
   p->state = USED;
   p->pid = nextpid++;
+  p->profiling = 0;
+  p->exiting = 0;
+  p->aring = 0;
+  p->aringexit = 0;
+  p->vproc = 0;
+  p->strace = 0;
+  memset(p->sccount, 0, sizeof(p->sccount));
+  memset(p->sccycles, 0, sizeof(p->sccycles));
+  memset(p->vma, 0, sizeof(p->vma));
 
   t = allocthread(p);
 
@@ -165,11 +287,14 @@ userinit(void)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
   p->sz = PGSIZE;
+  if((p->vproc = allocvproc(p->pgdir)) == 0)
+    panic("userinit: out of memory?");
   memset(t->tf, 0, sizeof(*t->tf));
   t->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   t->tf->ds = (SEG_UDATA << 3) | DPL_USER;
   t->tf->es = t->tf->ds;
   t->tf->ss = t->tf->ds;
+  t->tf->fs = (SEG_UTLS << 3) | DPL_USER;
   t->tf->eflags = FL_IF;
   t->tf->esp = PGSIZE;
   t->tf->eip = 0;  // beginning of initcode.S
@@ -177,7 +302,8 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  t->state = TRUNNABLE;
+  setrunnable(t);
+  vprocfill(p);
 
   release(&ptable.lock);
 }
@@ -187,25 +313,35 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, dead;
 
+  dead = 0;
+  acquire(&proc->vmlock);
   sz = proc->sz;
-  acquire(&ptable.lock);
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0){
-      release(&ptable.lock);
+    // Only reserve the space; pageFault() maps each page on first
+    // touch.
+    if(sz + n > MMAPBASE || sz + n < sz){
+      release(&proc->vmlock);
       return -1;
     }
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0){
-      release(&ptable.lock);
+    if(aringpinned(sz + n, sz)){
+      release(&proc->vmlock);
       return -1;
     }
+    sz = deallocuvm_defer(proc->pgdir, sz, sz + n, &dead);
   }
   proc->sz = sz;
   switchuvm(proc);
 
-  release(&ptable.lock);
+  release(&proc->vmlock);
+  if(n < 0){
+    // Siblings may still map the pages; free them only after.
+    tlbshootdown(proc);
+    kfreelist(dead);
+  }
   return 0;
 }
 
@@ -227,9 +363,31 @@ fork(void)
     return -1;
   }
   nt = np->threads;
+  release(&ptable.lock);
 
-  // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
+  // Share memory with p copy-on-write.  Sibling threads may still
+  // hold writable TLB entries for the pages copyuvm just made
+  // read-only, so flush them before the child can run.  MAP_SHARED
+  // regions are filled in first, so that both sides get the same
+  // pages rather than faulting in their own.
+  np->pgdir = 0;
+  if(vmfillshared() == 0){
+    acquire(&proc->vmlock);
+    np->pgdir = copyuvm(proc->pgdir, proc->sz, proc->vma);
+    np->sz = proc->sz;
+    release(&proc->vmlock);
+    tlbshootdown(proc);
+  }
+  acquire(&ptable.lock);
+  if(np->pgdir == 0){
+    kfree(nt->kstack);
+    nt->kstack = 0;
+    np->state = UNUSED;
+    release(&ptable.lock);
+    return -1;
+  }
+  if((np->vproc = allocvproc(np->pgdir)) == 0){
+    freevm(np->pgdir);
     kfree(nt->kstack);
     nt->kstack = 0;
     np->state = UNUSED;
@@ -237,7 +395,6 @@ fork(void)
     return -1;
   }
 
-  np->sz = proc->sz;
   np->parent = proc;
   *nt->tf = *thread->tf;
 
@@ -248,12 +405,16 @@ fork(void)
     if(proc->ofile[i])
       np->ofile[i] = filedup(proc->ofile[i]);
   np->cwd = idup(proc->cwd);
+  acquire(&proc->vmlock);
+  copyvmas(np->vma, proc->vma);
+  release(&proc->vmlock);
 
   safestrcpy(np->name, proc->name, sizeof(proc->name));
 
   pid = np->pid;
 
-  nt->state = TRUNNABLE;
+  setrunnable(nt);
+  vprocfill(np);
 
   release(&ptable.lock);
 
@@ -264,6 +425,9 @@ fork(void)
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// The first thread to get here owns the exit: it kills its siblings,
+// waits for them to leave the CPUs, and only then tears down files.
+// Any other thread that arrives later just retires itself.
 void
 exit(void)
 {
@@ -273,6 +437,18 @@ exit(void)
   if(proc == initproc)
     panic("init exiting");
 
+  acquire(&ptable.lock);
+  if(proc->exiting){
+    release(&ptable.lock);
+    killSelf();
+  }
+  proc->exiting = 1;
+  kill_all();
+  while(livethreads(proc) > 0)
+    sleep(proc, &ptable.lock);
+  proc->aring = 0;   // its worker is gone; unpin the memory
+  release(&ptable.lock);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(proc->ofile[fd]){
@@ -281,8 +457,12 @@ exit(void)
     }
   }
 
+  // Write back and drop mmap() regions.
+  munmap(MMAPBASE, USERTOP - MMAPBASE);
+
   begin_op();
   iput(proc->cwd);
+  freevmas(proc->vma);
   end_op();
   proc->cwd = 0;
 
@@ -300,18 +480,7 @@ exit(void)
     }
   }
 
-  //kill all threads in this process
-  struct thread *new_thread;
-  for (new_thread = proc -> threads; new_thread < &proc->threads[NTHREAD]; new_thread++)
-  {
-    if(new_thread->state != TRUNNING && new_thread->state != TUNUSED && new_thread != thread)
-    {
-      new_thread->state = TZOMBIE;
-    }
-  }
-
   // Jump into the scheduler, never to return.
-  kill_all();
   thread->state = TINVALID;
   proc->state = ZOMBIE;
 
@@ -325,6 +494,8 @@ clearThread(struct thread * t)
   if(t->state == TINVALID || t->state == TZOMBIE)
     kfree(t->kstack);
 
+  if(t->parent && t->parent->vproc)
+    t->parent->vproc->tid[t - t->parent->threads] = 0;
   t->kstack = 0;
   t->tid = 0;
   t->state = TUNUSED;
@@ -357,10 +528,12 @@ wait(void)
           clearThread(t);
 
         freevm(p->pgdir);
+        p->vproc = 0;
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
+        p->exiting = 0;
         p->state = UNUSED;
         release(&ptable.lock);
         return pid;
@@ -416,13 +589,24 @@ scheduler(void)
 		
 		 //cprintf("scheduler p loop 2 state=%d\n",p->state);
 		
+        runlat_record(t);
         t->state = TRUNNING;
+        t->lastcpu = cpu - cpus;
+        trace(TR_SCHED_IN, p->pid, 0);
         swtch(&cpu->scheduler, t->context);
 		
 				 //cprintf("scheduler p loop 3\n");
 		
 		
         switchkvm();
+        trace(TR_SCHED_OUT, t->state, 0);
+
+        // A thread that comes back runnable was preempted by
+        // yield(); one that comes back sleeping gave up the CPU.
+        if(t->state == TRUNNABLE)
+          t->nivcsw++;
+        else if(t->state == TSLEEPING)
+          t->nvcsw++;
 
 
         // Process is done running for now.
@@ -470,7 +654,7 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  thread->state = TRUNNABLE;
+  setrunnable(thread);
   sched();
   release(&ptable.lock);
 }
@@ -521,6 +705,7 @@ sleep(void *chan, struct spinlock *lk)
 
   
   // Go to sleep.
+  trace(TR_SLEEP, (uint)chan, 0);
   thread->chan = chan;
   thread->state = TSLEEPING;
   sched();
@@ -544,12 +729,13 @@ wakeup1(void *chan)
   struct proc *p;
   struct thread *t;
 
+  trace(TR_WAKEUP, (uint)chan, 0);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == USED)
     {
       for(t = p->threads; t < &p->threads[NTHREAD]; t++)
         if(t->state == TSLEEPING && t->chan == chan)
-          t->state = TRUNNABLE;
+          setrunnable(t);
     }
 }
 
@@ -573,12 +759,13 @@ kill(int pid)
 
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
+    if(p->pid == pid && p != kproc){
       p->killed = 1;
       // Wake process from sleep if necessary.
       for(t = p->threads; t < &p->threads[NTHREAD]; t++)
         if(t->state == TSLEEPING)
-          t->state = TRUNNABLE;
+          setrunnable(t);
+      kickthreads(p);
 
       release(&ptable.lock);
       return 0;
@@ -588,6 +775,75 @@ kill(int pid)
   return -1;
 }
 
+// Turn timer-tick profiling of process pid on or off.
+// Profiling stays on across exec.
+int
+profctl(int pid, int on)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state == USED && p->pid == pid){
+      p->profiling = on;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Turn syscall logging of process pid on or off.
+// Like profiling it stays on across exec.
+int
+stracectl(int pid, int on)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->pid == pid){
+      p->strace = on;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Copy process pid's syscall counters for the first n syscall
+// numbers into st and optionally reset them.  Returns n, or -1
+// if there is no such process.
+int
+procscstats(int pid, struct scstat *st, int n, int reset)
+{
+  struct proc *p;
+  int i;
+
+  if(n > NSYSCALLS)
+    n = NSYSCALLS;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state == UNUSED || p->pid != pid)
+      continue;
+    memset(st, 0, n * sizeof(*st));
+    for(i = 0; i < n; i++){
+      st[i].count = p->sccount[i];
+      st[i].cycles = p->sccycles[i];
+    }
+    if(reset){
+      memset(p->sccount, 0, sizeof(p->sccount));
+      memset(p->sccycles, 0, sizeof(p->sccycles));
+    }
+    release(&ptable.lock);
+    return n;
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
 // Kill the threads with of given process with pid.
 // Thread won't exit until it returns
 // to user space (see trap in trap.c).
@@ -596,6 +852,8 @@ killSelf()
 {
   acquire(&ptable.lock);
   wakeup1(thread);
+  if(proc->exiting)
+    wakeup1(proc);    // the exiting thread waits in exit() for us to leave
   thread->state = TINVALID; // thread must INVALID itself! - else two cpu's can run on the same thread
   sched();
 }
@@ -612,11 +870,20 @@ procdump(void)
   [USED]    "used",
   [ZOMBIE]    "zombie"
   };
+  static char *threadstates[] = {
+  [TUNUSED]   "unused",
+  [TEMBRYO]   "embryo",
+  [TSLEEPING] "sleep ",
+  [TRUNNABLE] "runble",
+  [TRUNNING]  "run   ",
+  [TZOMBIE]   "zombie",
+  [TINVALID]  "invalid"
+  };
  
   int i;
   struct proc *p;
   struct thread *t;
-  char *state;//, *threadState;
+  char *state, *threadState;
   uint pc[10];
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
@@ -629,9 +896,21 @@ procdump(void)
 
     cprintf("%d %s %s\n", p->pid, state, p->name);
     for(t = p->threads; t < &p->threads[NTHREAD]; t++){
- 
+      if(t->state == TUNUSED)
+        continue;
+      if(t->state >= 0 && t->state < NELEM(threadstates))
+        threadState = threadstates[t->state];
+      else
+        threadState = "???";
+      cprintf("  tid %d %s cpu %d user %d sys %d csw %d/%d",
+              t->tid, threadState, t->lastcpu, t->uticks, t->kticks,
+              t->nvcsw, t->nivcsw);
+      if(t->kfn)
+        cprintf(" fn %p", t->kfn);
+      cprintf("\n");
 
       if(t->state == TSLEEPING){
+        cprintf("  ");
         getcallerpcs((uint*)t->context->ebp+2, pc);
         for(i=0; i<10 && pc[i] != 0; i++)
           cprintf("%p ", pc[i]);
@@ -641,6 +920,169 @@ procdump(void)
 
 
   }
+  slabdump();
+}
+
+// Copy the run-queue latency histograms of up to n CPUs
+// into hist, NRUNLAT counters per CPU, and optionally clear
+// them.  Returns the number of CPUs copied.
+int
+runlatstats(uint *hist, int n, int reset)
+{
+  int c;
+
+  if(n > ncpu)
+    n = ncpu;
+  acquire(&ptable.lock);
+  for(c = 0; c < n; c++){
+    memmove(hist + c*NRUNLAT, cpus[c].runlat, sizeof(cpus[c].runlat));
+    if(reset)
+      memset(cpus[c].runlat, 0, sizeof(cpus[c].runlat));
+  }
+  release(&ptable.lock);
+  return n;
+}
+
+// Copy CPU accounting for up to n live threads into ts.
+// Returns the number of entries filled in.
+int
+threadstats(struct threadstat *ts, int n)
+{
+  struct proc *p;
+  struct thread *t;
+  int k;
+
+  k = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && k < n; p++){
+    if(p->state == UNUSED)
+      continue;
+    for(t = p->threads; t < &p->threads[NTHREAD] && k < n; t++){
+      if(t->state == TUNUSED)
+        continue;
+      ts[k].pid = p->pid;
+      ts[k].tid = t->tid;
+      ts[k].state = t->state;
+      ts[k].cpu = t->lastcpu;
+      ts[k].uticks = t->uticks;
+      ts[k].kticks = t->kticks;
+      ts[k].nvcsw = t->nvcsw;
+      ts[k].nivcsw = t->nivcsw;
+      safestrcpy(ts[k].name, p->name, sizeof(ts[k].name));
+      k++;
+    }
+  }
+  release(&ptable.lock);
+  return k;
+}
+
+// First code run by a kernel thread, entered from scheduler()
+// through swtch with ptable.lock held.  When the body returns the
+// thread turns zombie; allocthread() reclaims the slot later.
+static void
+kthreadstart(void)
+{
+  release(&ptable.lock);
+
+  thread->kfn(thread->karg);
+
+  acquire(&ptable.lock);
+  wakeup1(thread);
+  if(proc->exiting)
+    wakeup1(proc);
+  thread->state = TZOMBIE;
+  sched();
+  panic("zombie kthread");
+}
+
+// Point a new thread of p at kthreadstart and make it runnable.
+// Must hold ptable.lock.
+static int
+kthreadalloc(struct proc *p, void (*fn)(void*), void *arg)
+{
+  struct thread *t;
+
+  if((t = allocthread(p)) == 0)
+    return -1;
+  t->kfn = fn;
+  t->karg = arg;
+  t->context->eip = (uint)kthreadstart;
+  setrunnable(t);
+  return t->tid;
+}
+
+// Start a kernel thread running fn(arg).  Kernel threads have no
+// user address space, files or cwd: they all live in one process,
+// kproc, whose page table maps only the kernel, and are scheduled
+// like any other thread.  Safe to call from main() once pinit()
+// has run.  Returns the new thread's tid, or -1.
+int
+kthread_run(void (*fn)(void*), void *arg)
+{
+  int tid;
+
+  acquire(&ptable.lock);
+  if(kproc == 0){
+    if((kproc = allocproc()) == 0)
+      goto bad;
+    // allocproc() set up a user thread in slot 0 that we do not want.
+    kfree(kproc->threads[0].kstack);
+    kproc->threads[0].kstack = 0;
+    if((kproc->pgdir = setupkvm()) == 0){
+      kproc->state = UNUSED;
+      kproc = 0;
+      goto bad;
+    }
+    kproc->sz = 0;
+    kproc->parent = 0;
+    kproc->cwd = 0;
+    safestrcpy(kproc->name, "kthreads", sizeof(kproc->name));
+  }
+  tid = kthreadalloc(kproc, fn, arg);
+  release(&ptable.lock);
+  return tid;
+
+bad:
+  release(&ptable.lock);
+  return -1;
+}
+
+// Start a kernel thread running fn(arg) inside the calling process,
+// so that it sees the process's memory, files and cwd.  fn must
+// return once proc->killed is set; exit() waits for it.
+// Returns the new thread's tid, or -1.
+int
+kthread_run_proc(void (*fn)(void*), void *arg)
+{
+  int tid;
+
+  acquire(&ptable.lock);
+  tid = kthreadalloc(proc, fn, arg);
+  release(&ptable.lock);
+  return tid;
+}
+
+// Wait until the kernel thread tid of the calling process, started
+// by kthread_run_proc, has returned, and free its slot.  Unlike
+// kthread_join this does not give up if the process is killed,
+// since the caller is about to take away what the thread uses.
+void
+kthread_wait_proc(int tid)
+{
+  struct thread *t;
+
+  acquire(&ptable.lock);
+  for(t = proc->threads; t < &proc->threads[NTHREAD]; t++){
+    if(t == thread || t->tid != tid)
+      continue;
+    while(t->tid == tid && (t->state == TSLEEPING || t->state == TRUNNABLE ||
+                            t->state == TRUNNING))
+      sleep(t, &ptable.lock);   // kthreadstart wakes us
+    if(t->tid == tid && t->state == TZOMBIE)
+      clearThread(t);
+    break;
+  }
+  release(&ptable.lock);
 }
 
 int kthread_create(void *(start_func)(), void *stack, int stack_size) {
@@ -679,7 +1121,7 @@ int kthread_create(void *(start_func)(), void *stack, int stack_size) {
   new_thread->tf->eip = (uint)start_func;
 
   //mark thread as runnable
-  new_thread->state = TRUNNABLE;
+  setrunnable(new_thread);
 
   release(&ptable.lock);
 
@@ -704,7 +1146,8 @@ void kthread_exit() {
   {
   //If t is not current thread (because calling thread is current)
   //If t is not Unused, not Zombied and not Invalid
-   if (new_thread != thread) {
+  //Kernel threads (the aring worker) don't count: exit() reaps them
+   if (new_thread != thread && !new_thread->kfn) {
     if (new_thread->state != TUNUSED && new_thread->state != TZOMBIE && new_thread->state != TINVALID) {
       found = 1;
       break;
@@ -714,11 +1157,11 @@ void kthread_exit() {
 
   if (found) {
     wakeup1(thread);
+    if (proc->exiting)
+      wakeup1(proc);
   } else {
-    kill_all();
     release(&ptable.lock);
     exit();
-    wakeup(thread);
   }
 
   thread->state = TZOMBIE;
@@ -763,6 +1206,12 @@ int kthread_join(int thread_id) {
   //While (t->t_id = thread_id and valid)
   while (new_thread->tid == thread_id && new_thread->state != TZOMBIE && new_thread->state != TUNUSED && new_thread->state != TINVALID )
   {
+    // The target may be the thread tearing the process down in exit(),
+    // which in turn waits for us: give up instead of deadlocking.
+    if (proc->killed) {
+      release(&ptable.lock);
+      return -1;
+    }
     //Make t sleep using sleep method with a lock
     sleep(new_thread, &ptable.lock);
     // release(&ptable.lock);
@@ -780,21 +1229,22 @@ int kthread_join(int thread_id) {
 }
 
 
+// Kill every other thread of the current process and make sure
+// each of them notices promptly: sleepers are woken, and threads
+// running on other CPUs are interrupted instead of being left to
+// spin in user space until their next timer tick.
+// Caller must hold ptable.lock.
 void kill_all(void) {
 
  struct thread *new_thread;
+
+ proc->killed = 1;
  for (new_thread = proc->threads; new_thread < &proc->threads[NTHREAD]; new_thread++)
  {
-  //If ( thread t is not current thread and not running and not unused)->
-  if (new_thread != thread && new_thread->state != TRUNNING && new_thread->state!= TUNUSED) 
-  {
-    new_thread->state = TZOMBIE;
-  }
+  if (new_thread != thread && new_thread->state == TSLEEPING)
+    setrunnable(new_thread);
  }
- //Make current thread zombie -> find current thread and change its state
-  thread->state = TZOMBIE;
-  //Kill process -> proc->killed = 1
-  proc->killed = 1;
+ kickthreads(proc);
 }
 
 void kill_others(void)
@@ -870,6 +1320,10 @@ int kthread_mutex_lock(int mutex_id) {
             }
 
             for (; mtable.mutexes[i].state == MLOCKED;) {
+              if (proc->killed) {
+                release(&mtable.lock);
+                return -1;
+              }
               sleep((void*)&mtable.mutexes[i], &mtable.lock);
             }
             mtable.mutexes[i].state = MLOCKED;
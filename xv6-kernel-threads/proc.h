@@ -1,5 +1,7 @@
 #include "kthread.h"
 #include "spinlock.h"
+#include "runlat.h"
+#include "scstat.h"
 
 // Per-CPU state
 struct cpu {
@@ -10,12 +12,15 @@ struct cpu {
   volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  int indefer;                 // Running deferred interrupt work, see defer.c
+  volatile uint tlbgen;        // TLB flushes done for IPIs, see tlbshootdown
 
   // Cpu-local storage variables; see below
   struct cpu *cpu;
   struct proc *proc;           // The currently-running process.
   struct thread *thread;
 
+  uint runlat[NRUNLAT];        // Run-queue latency histogram, see runlat.h
 };
 
 struct thread* mythread(void);
@@ -78,19 +83,60 @@ struct thread {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+
+  // CPU accounting, exported by threadstat()
+  uint uticks;                 // Timer ticks spent in user mode
+  uint kticks;                 // Timer ticks spent in the kernel
+  uint nvcsw;                  // Voluntary context switches (slept)
+  uint nivcsw;                 // Involuntary context switches (preempted)
+  int lastcpu;                 // CPU this thread last ran on
+  uint64 readytsc;             // rdtsc when last made TRUNNABLE
+
+  void (*kfn)(void*);          // Kernel threads only: body and its argument,
+  void *karg;                  //   see kthread_run
 };
 
 // Per-process state
+#define NVMA 16
+
+// A range of user memory filled in on demand by pageFault():
+// from a file (exec'd program segments, mmap()), from a shared
+// memory segment (shm_attach()) or with zeros.
+struct vma {
+  uint start;                  // Page aligned
+  uint end;                    // Page aligned, exclusive; 0 if unused
+  struct inode *ip;            // Backing file, or 0
+  struct shm *shm;             // Backing segment, or 0; see shm.c
+  uint off;                    // File offset of start
+  uint filesz;                 // Bytes of file data from start, then zeros
+  int flags;                   // VMA_*
+};
+
+#define VMA_WRITE  0x1         // Writable
+#define VMA_SHARED 0x2         // Pages shared with fork children, and
+                               //   written back to the file
+
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
+  struct spinlock vmlock;      // Serializes changes to pgdir and sz
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
   int killed;                  // If non-zero, have been killed
+  int exiting;                 // If non-zero, a thread is in exit()
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int profiling;               // If non-zero, sample on timer ticks
+  struct aring *aring;         // Async syscall ring, see aring.c
+  int aringtid;                // and the tid of its worker thread
+  int aringexit;               // If non-zero, the worker must return
+  struct vproc *vproc;         // Kernel address of the VPROC page, see vdso.c
+  int strace;                  // If non-zero, log syscalls, see syscall.c
+  uint sccount[NSYSCALLS];     // Syscalls made, by number
+  uint64 sccycles[NSYSCALLS];  // and the cycles they took
+  struct vma vma[NVMA];        // Demand-paged ranges, under vmlock
   struct thread threads[NTHREAD]; // static thread array
 };
 
@@ -0,0 +1,219 @@
+// Flat profile of a command from timer-tick samples.
+// Samples are resolved against the .sym files that the
+// Makefile puts in the file system next to each program.
+//
+// usage: prof command [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "prof.h"
+
+#define NSYM     1024
+#define SYMLEN   24
+#define NSAMPLE  (NCPU*NPROF)
+
+struct sym {
+  uint addr;
+  uint hits;
+  char name[SYMLEN];
+};
+
+struct symtab {
+  struct sym sym[NSYM];
+  int n;
+  uint unknown;    // samples with no symbol below them
+};
+
+struct symtab usyms, ksyms;
+struct profsample samples[NSAMPLE];
+char filebuf[512];
+int child;
+volatile int done;
+uint total;
+
+int
+ishex(char c)
+{
+  return ('0' <= c && c <= '9') || ('a' <= c && c <= 'f');
+}
+
+// Parse one "xxxxxxxx name" line of a .sym file into t.
+void
+addsym(struct symtab *t, char *line, int len)
+{
+  struct sym *s;
+  uint addr;
+  int i, j;
+
+  if(len < 10 || t->n >= NSYM)
+    return;
+  addr = 0;
+  for(i = 0; i < 8; i++){
+    if(!ishex(line[i]))
+      return;
+    addr = addr*16 + (line[i] <= '9' ? line[i] - '0' : line[i] - 'a' + 10);
+  }
+  // Skip source file names, which share address 0.
+  if(len > 11 && line[len-2] == '.' && (line[len-1] == 'c' || line[len-1] == 'S'))
+    return;
+
+  // Insertion keeps the table sorted by address.
+  for(j = t->n; j > 0 && t->sym[j-1].addr > addr; j--)
+    t->sym[j] = t->sym[j-1];
+  s = &t->sym[j];
+  s->addr = addr;
+  s->hits = 0;
+  for(i = 0; i < SYMLEN-1 && 9+i < len; i++)
+    s->name[i] = line[9+i];
+  s->name[i] = 0;
+  t->n++;
+}
+
+int
+loadsyms(struct symtab *t, char *path)
+{
+  char line[64];
+  int fd, n, i, len;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  len = 0;
+  while((n = read(fd, filebuf, sizeof(filebuf))) > 0){
+    for(i = 0; i < n; i++){
+      if(filebuf[i] == '\n'){
+        addsym(t, line, len);
+        len = 0;
+      } else if(len < sizeof(line))
+        line[len++] = filebuf[i];
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+// Charge one sample at eip to its enclosing symbol.
+void
+hit(struct symtab *t, uint eip)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = t->n - 1;
+  if(hi < 0 || eip < t->sym[0].addr){
+    t->unknown++;
+    return;
+  }
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(t->sym[mid].addr <= eip)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  t->sym[lo].hits++;
+}
+
+void
+collect(void)
+{
+  int i, n;
+
+  n = profread(samples, NSAMPLE);
+  for(i = 0; i < n; i++){
+    if(samples[i].pid != child)
+      continue;
+    hit(samples[i].user ? &usyms : &ksyms, samples[i].eip);
+    total++;
+  }
+}
+
+// Collector thread: drain the per-CPU buffers before they fill.
+void*
+collector(void)
+{
+  while(!done){
+    sleep(50);
+    collect();
+  }
+  kthread_exit();
+  return 0;
+}
+
+void
+report(struct symtab *t, char *tag)
+{
+  int i, best;
+  struct sym *s;
+
+  for(;;){
+    best = -1;
+    for(i = 0; i < t->n; i++)
+      if(t->sym[i].hits && (best < 0 || t->sym[i].hits > t->sym[best].hits))
+        best = i;
+    if(best < 0)
+      break;
+    s = &t->sym[best];
+    printf(1, "%d\t%d%%\t%s %s\n", s->hits, s->hits * 100 / total, tag, s->name);
+    s->hits = 0;
+  }
+  if(t->unknown)
+    printf(1, "%d\t%d%%\t%s ?\n", t->unknown, t->unknown * 100 / total, tag);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[32], *base, *p;
+  int tid;
+
+  if(argc < 2){
+    printf(2, "usage: prof command [args...]\n");
+    exit();
+  }
+  base = argv[1];
+  for(p = argv[1]; *p; p++)
+    if(*p == '/')
+      base = p + 1;
+  if(strlen(base) + 5 > sizeof(path)){
+    printf(2, "prof: name too long\n");
+    exit();
+  }
+  strcpy(path, base);
+  strcpy(path + strlen(path), ".sym");
+  if(loadsyms(&usyms, path) < 0)
+    printf(2, "prof: no %s, user samples unresolved\n", path);
+  if(loadsyms(&ksyms, "kernel.sym") < 0)
+    printf(2, "prof: no kernel.sym, kernel samples unresolved\n");
+
+  profread(samples, NSAMPLE);  // discard stale samples
+  child = fork();
+  if(child < 0){
+    printf(2, "prof: fork failed\n");
+    exit();
+  }
+  if(child == 0){
+    profctl(getpid(), 1);
+    exec(argv[1], argv + 1);
+    printf(2, "prof: exec %s failed\n", argv[1]);
+    exit();
+  }
+
+  tid = kthread_create(collector, malloc(4096), 4096);
+  wait();
+  done = 1;
+  if(tid >= 0)
+    kthread_join(tid);
+  collect();
+
+  if(total == 0){
+    printf(1, "prof: no samples\n");
+    exit();
+  }
+  printf(1, "%d samples\nsamples\t%%\tfunction\n", total);
+  report(&usyms, "user");
+  report(&ksyms, "kern");
+  exit();
+}
@@ -0,0 +1,12 @@
+// Timer-tick sampling profiler.  See kprof.c.
+
+#define NPROF 1024  // samples buffered per CPU
+
+struct profsample {
+  uint eip;          // Interrupted instruction
+  int pid;           // Process that was running
+  int tid;           // Thread that was running
+  uchar cpu;         // CPU that took the sample
+  uchar user;        // 1 if eip is a user address
+  ushort pad;
+};
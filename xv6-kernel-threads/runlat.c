@@ -0,0 +1,91 @@
+// Print the scheduler's run-queue latency histograms: how
+// long threads sat runnable before getting a CPU.
+// With -r, reset the histograms after reading.
+//
+// usage: runlat [-r]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "runlat.h"
+
+uint hist[NCPU][NRUNLAT];
+uint total[NRUNLAT];
+
+// Print the upper bound of bucket b, 2^(b+1) cycles.
+void
+printbound(int b)
+{
+  if(b + 1 < 31)
+    printf(1, "%d", 1 << (b + 1));
+  else
+    printf(1, "2^%d", b + 1);
+}
+
+// Bucket holding the pct'th percentile of n samples.
+int
+percentile(uint n, int pct)
+{
+  uint want, seen;
+  int b;
+
+  want = (n / 100) * pct + (n % 100) * pct / 100;
+  if(want == 0)
+    want = 1;
+  seen = 0;
+  for(b = 0; b < NRUNLAT; b++){
+    seen += total[b];
+    if(seen >= want)
+      return b;
+  }
+  return NRUNLAT - 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int c, b, ncpu, reset, max;
+  uint n;
+
+  reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+  if((ncpu = runlat(&hist[0][0], NCPU, reset)) < 0){
+    printf(2, "runlat: failed\n");
+    exit();
+  }
+
+  n = 0;
+  for(c = 0; c < ncpu; c++){
+    printf(1, "cpu%d:", c);
+    for(b = 0; b < NRUNLAT; b++){
+      total[b] += hist[c][b];
+      n += hist[c][b];
+      if(hist[c][b]){
+        printf(1, " <");
+        printbound(b);
+        printf(1, ":%d", hist[c][b]);
+      }
+    }
+    printf(1, "\n");
+  }
+  if(n == 0){
+    printf(1, "no samples\n");
+    exit();
+  }
+
+  max = 0;
+  for(b = 0; b < NRUNLAT; b++)
+    if(total[b])
+      max = b;
+  printf(1, "%d dispatches, cycles waited:\n", n);
+  printf(1, "  p50 <");
+  printbound(percentile(n, 50));
+  printf(1, "  p90 <");
+  printbound(percentile(n, 90));
+  printf(1, "  p99 <");
+  printbound(percentile(n, 99));
+  printf(1, "  max <");
+  printbound(max);
+  printf(1, "\n");
+  exit();
+}
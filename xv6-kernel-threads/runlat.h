@@ -0,0 +1,5 @@
+// Run-queue latency histograms: how long threads waited in
+// TRUNNABLE before a CPU picked them up.  Bucket i counts waits
+// of [2^i, 2^(i+1)) TSC cycles; the last bucket also counts
+// anything longer.
+#define NRUNLAT 40
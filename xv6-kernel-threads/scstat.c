@@ -0,0 +1,158 @@
+// Syscall statistics and tracing.
+//
+//   scstat              system-wide counts and latency per syscall
+//   scstat -r           the same, then reset the counters
+//   scstat -p pid       counts and average latency for one process
+//   scstat -t cmd args  run cmd, logging each syscall it makes
+//
+// Latencies are in rdtsc cycles; p50 and p99 are the power-of-two
+// histogram bucket that holds that percentile.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "syscall.h"
+#include "sysnames.h"
+#include "kthread.h"
+#include "scstat.h"
+
+static struct scstat st[NSYSCALLS];
+static struct straceent ents[NSTRACE];
+static volatile int done;
+static int child;
+
+static char*
+name(int num)
+{
+  if(num > 0 && num < sizeof(sysnames)/sizeof(sysnames[0]) && sysnames[num])
+    return sysnames[num];
+  return "?";
+}
+
+// Average cycles per call without 64-bit division.
+static uint
+avg(uint64 cycles, uint count)
+{
+  if(count == 0)
+    return 0;
+  if(cycles >> 32)
+    return ((uint)(cycles >> 10) / count) << 10;
+  return (uint)cycles / count;
+}
+
+// Lower bound of the bucket holding percentile pct of s's calls.
+static uint
+pctl(struct scstat *s, int pct)
+{
+  uint want, seen;
+  int b;
+
+  want = (s->count * pct + 99) / 100;
+  seen = 0;
+  for(b = 0; b < NSCLAT; b++){
+    seen += s->hist[b];
+    if(seen >= want)
+      return 1 << b;
+  }
+  return 0;
+}
+
+static void
+show(int pid, int n)
+{
+  int i;
+
+  if(pid == 0)
+    printf(1, "syscall\tcount\tavg\tp50\tp99\n");
+  else
+    printf(1, "syscall\tcount\tavg\n");
+  for(i = 1; i < n; i++){
+    if(st[i].count == 0)
+      continue;
+    if(pid == 0)
+      printf(1, "%s\t%d\t%d\t%d\t%d\n", name(i), st[i].count,
+             avg(st[i].cycles, st[i].count), pctl(&st[i], 50), pctl(&st[i], 99));
+    else
+      printf(1, "%s\t%d\t%d\n", name(i), st[i].count,
+             avg(st[i].cycles, st[i].count));
+  }
+}
+
+static void
+drain(void)
+{
+  int i, n;
+  struct straceent *e;
+
+  while((n = straceread(ents, NSTRACE)) > 0){
+    for(i = 0; i < n; i++){
+      e = &ents[i];
+      printf(2, "%d/%d %s(%d, %d, %d) = %d  [%d cycles]\n", e->pid, e->tid,
+             name(e->num), e->arg[0], e->arg[1], e->arg[2], e->ret, e->cycles);
+    }
+  }
+}
+
+// Drain the strace ring while the child runs, before it wraps.
+void*
+drainer(void)
+{
+  while(!done){
+    sleep(10);
+    drain();
+  }
+  kthread_exit();
+  return 0;
+}
+
+static void
+tracecmd(char **argv)
+{
+  char *stack;
+  int tid;
+
+  child = fork();
+  if(child < 0){
+    printf(2, "scstat: fork failed\n");
+    exit();
+  }
+  if(child == 0){
+    strace(getpid(), 1);
+    exec(argv[0], argv);
+    printf(2, "scstat: exec %s failed\n", argv[0]);
+    exit();
+  }
+  stack = malloc(4096);
+  tid = kthread_create(drainer, stack, 4096);
+  wait();
+  done = 1;
+  if(tid > 0)
+    kthread_join(tid);
+  drain();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if(argc >= 3 && strcmp(argv[1], "-t") == 0){
+    tracecmd(argv + 2);
+    exit();
+  }
+  if(argc >= 3 && strcmp(argv[1], "-p") == 0){
+    if((n = scstat(atoi(argv[2]), st, NSYSCALLS, 0)) < 0){
+      printf(2, "scstat: no process %s\n", argv[2]);
+      exit();
+    }
+    show(atoi(argv[2]), n);
+    exit();
+  }
+  if(argc >= 2 && strcmp(argv[1], "-r") != 0){
+    printf(2, "usage: scstat [-r] | -p pid | -t cmd [args...]\n");
+    exit();
+  }
+  n = scstat(0, st, NSYSCALLS, argc >= 2);
+  show(0, n);
+  exit();
+}
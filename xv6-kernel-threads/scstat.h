@@ -0,0 +1,22 @@
+// Per-syscall statistics and strace-style logging.  See syscall.c.
+
+#define NSYSCALLS 52   // counters kept for syscall numbers below this
+#define NSCLAT    32   // latency histogram buckets: bucket b counts
+                       //   calls that took [2^b, 2^(b+1)) cycles
+#define NSTRACE  256   // entries in the strace ring
+
+struct scstat {
+  uint count;          // calls made
+  uint64 cycles;       // total rdtsc cycles spent in them
+  uint hist[NSCLAT];   // system-wide only; zero per process
+};
+
+struct straceent {
+  uint64 tsc;          // rdtsc when the call returned
+  int pid;
+  int tid;
+  int num;             // syscall number
+  uint arg[3];         // first three argument words
+  int ret;
+  uint cycles;         // time spent in the call
+};
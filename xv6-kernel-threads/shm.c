@@ -0,0 +1,198 @@
+// Shared memory segments.
+//
+// shm_create(key, size) allocates a segment of zeroed pages under an
+// integer key, and shm_attach(key) maps it into the calling process
+// (see shmattach in vm.c).  Each attachment is a VMA_SHARED vma
+// pointing at the segment, whose pages pageFault() maps writable.
+// The segment holds one reference to each of its pages and every
+// mapping another, so a page lives as long as anyone can reach it.
+// fork() copies the vma and shares the pages like any other
+// MAP_SHARED region.
+//
+// ref counts the vmas attached to a segment.  When the last one goes
+// (shm_detach, munmap, exit or exec) the segment and its key are
+// released.  shm_remove(key) releases the key at once, and the
+// segment too if nothing is attached; a segment that is never
+// attached stays until then.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+
+#define NSHM    16
+#define SHMMAXPG (PGSIZE / sizeof(char*))   // pages in a segment
+
+struct shm {
+  int key;
+  int ref;            // vmas attached
+  int gone;           // key removed; freed with the last attachment
+  uint npages;
+  char **pg;          // page of page pointers; 0 if unused
+};
+
+static struct {
+  struct spinlock lock;
+  struct shm seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Free a segment's pages and the page listing them.
+static void
+shmfree(char **pg, uint npages)
+{
+  uint i;
+
+  for(i = 0; i < npages; i++)
+    if(pg[i])
+      kfree(pg[i]);
+  kfree((char*)pg);
+}
+
+// Create a segment of size bytes under key.  Returns 0, or -1 if
+// the key is taken, size is too big or memory ran out.
+int
+shmcreate(int key, uint size)
+{
+  struct shm *s, *e;
+  char **pg;
+  uint i, n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(n == 0 || n > SHMMAXPG)
+    return -1;
+  // Allocate before taking the lock; kalloc_zeroed may be slow.
+  if((pg = (char**)kalloc_zeroed()) == 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    if((pg[i] = kalloc_zeroed()) == 0){
+      shmfree(pg, n);
+      return -1;
+    }
+  }
+
+  acquire(&shmtab.lock);
+  s = 0;
+  for(e = shmtab.seg; e < &shmtab.seg[NSHM]; e++){
+    if(e->pg && !e->gone && e->key == key){
+      s = 0;
+      break;
+    }
+    if(e->pg == 0 && s == 0)
+      s = e;
+  }
+  if(s == 0){
+    release(&shmtab.lock);
+    shmfree(pg, n);
+    return -1;
+  }
+  s->key = key;
+  s->ref = 0;
+  s->gone = 0;
+  s->npages = n;
+  s->pg = pg;
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Look up the segment under key and count a new attachment.
+// Returns 0 if there is none.
+struct shm*
+shmget(int key)
+{
+  struct shm *s;
+
+  acquire(&shmtab.lock);
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++){
+    if(s->pg && !s->gone && s->key == key){
+      s->ref++;
+      release(&shmtab.lock);
+      return s;
+    }
+  }
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Count another vma attached to s, for fork or a split.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  s->ref++;
+  release(&shmtab.lock);
+}
+
+// Drop an attachment of s, releasing the segment after the last.
+void
+shmput(struct shm *s)
+{
+  char **pg;
+  uint n;
+
+  acquire(&shmtab.lock);
+  if(--s->ref > 0){
+    release(&shmtab.lock);
+    return;
+  }
+  pg = s->pg;
+  n = s->npages;
+  s->pg = 0;
+  release(&shmtab.lock);
+  // Mappings hold their own references to the pages.
+  shmfree(pg, n);
+}
+
+// Remove key.  Its segment is released now if nothing is attached,
+// else with the last attachment.  Returns -1 if there is no such key.
+int
+shmremove(int key)
+{
+  struct shm *s;
+  char **pg;
+  uint n;
+
+  acquire(&shmtab.lock);
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++)
+    if(s->pg && !s->gone && s->key == key)
+      break;
+  if(s == &shmtab.seg[NSHM]){
+    release(&shmtab.lock);
+    return -1;
+  }
+  s->gone = 1;
+  if(s->ref > 0){
+    release(&shmtab.lock);
+    return 0;
+  }
+  pg = s->pg;
+  n = s->npages;
+  s->pg = 0;
+  release(&shmtab.lock);
+  shmfree(pg, n);
+  return 0;
+}
+
+// Size of s in bytes.
+uint
+shmsize(struct shm *s)
+{
+  return s->npages * PGSIZE;
+}
+
+// Page i of s, or 0 if s is smaller.  The caller holds an
+// attachment, and must kdup() the page to map it.
+char*
+shmpage(struct shm *s, uint i)
+{
+  if(i >= s->npages)
+    return 0;
+  return s->pg[i];
+}
@@ -0,0 +1,170 @@
+// Producer/consumer throughput through a pipe and through a ring
+// buffer in a shared memory segment.  The producer fills a 4 KB
+// chunk at a time and the consumer checksums what it receives.
+// Through the pipe each chunk is copied in and out of the kernel
+// 512 bytes at a time; through the segment the producer copies it
+// into the ring once and the consumer reads it in place.  The
+// consumer is a fork child using the parent's attachment.
+//
+// Both sides spin while the ring is full or empty, so run with
+// more than one CPU.
+//
+// usage: shmbench [mb]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define CHUNK   4096
+#define RINGSZ  (16*CHUNK)
+#define SHMKEY  0x5348
+
+// Keep the compiler from moving buffer accesses across updates of
+// head and tail; x86 does not reorder them itself.
+#define barrier()  asm volatile("" ::: "memory")
+
+struct ring {
+  volatile uint head;          // bytes produced
+  char pad0[60];
+  volatile uint tail;          // bytes consumed
+  char pad1[60];
+  char buf[RINGSZ];
+};
+
+static void
+fill(char *p, uint off)
+{
+  int i;
+
+  for(i = 0; i < CHUNK; i++)
+    p[i] = (off + i) * 7;
+}
+
+static uint
+sum(char *p)
+{
+  uint s;
+  int i;
+
+  s = 0;
+  for(i = 0; i < CHUNK; i++)
+    s += (uchar)p[i];
+  return s;
+}
+
+// What the consumer should add up from total bytes.
+static uint
+expect(uint total)
+{
+  static char buf[CHUNK];
+  uint off, s;
+
+  s = 0;
+  for(off = 0; off < total; off += CHUNK){
+    fill(buf, off);
+    s += sum(buf);
+  }
+  return s;
+}
+
+static void
+pipebench(uint total)
+{
+  static char buf[CHUNK];
+  int fd[2], n, m;
+  uint off, s, want;
+  uint64 t0;
+
+  if(pipe(fd) < 0){
+    printf(2, "shmbench: pipe failed\n");
+    exit();
+  }
+  want = expect(total);
+  t0 = rdtsc();
+  if(fork() == 0){
+    close(fd[1]);
+    s = 0;
+    for(off = 0; off < total; off += CHUNK){
+      for(n = 0; n < CHUNK; n += m){
+        if((m = read(fd[0], buf + n, CHUNK - n)) <= 0){
+          printf(1, "shmbench: pipe read failed\n");
+          exit();
+        }
+      }
+      s += sum(buf);
+    }
+    if(s != want)
+      printf(1, "shmbench: pipe data corrupt\n");
+    exit();
+  }
+  close(fd[0]);
+  for(off = 0; off < total; off += CHUNK){
+    fill(buf, off);
+    write(fd[1], buf, CHUNK);
+  }
+  close(fd[1]);
+  wait();
+  printf(1, "pipe: %d cycles per KB\n", percall(rdtsc() - t0, total/1024));
+}
+
+static void
+shmbench(uint total)
+{
+  struct ring *r;
+  uint off, s, want;
+  uint64 t0;
+
+  if(shm_create(SHMKEY, sizeof(struct ring)) < 0){
+    printf(2, "shmbench: shm_create failed\n");
+    return;
+  }
+  if((r = shm_attach(SHMKEY)) == (void*)-1){
+    printf(2, "shmbench: shm_attach failed\n");
+    shm_remove(SHMKEY);
+    return;
+  }
+
+  want = expect(total);
+  t0 = rdtsc();
+  if(fork() == 0){
+    s = 0;
+    for(off = 0; off < total; off += CHUNK){
+      while(r->head == off)
+        ;
+      barrier();
+      s += sum(r->buf + off % RINGSZ);
+      barrier();
+      r->tail = off + CHUNK;
+    }
+    if(s != want)
+      printf(1, "shmbench: shm data corrupt\n");
+    exit();
+  }
+  for(off = 0; off < total; off += CHUNK){
+    while(off - r->tail >= RINGSZ)
+      ;
+    barrier();
+    fill(r->buf + off % RINGSZ, off);
+    barrier();
+    r->head = off + CHUNK;
+  }
+  wait();
+  printf(1, "shm: %d cycles per KB\n", percall(rdtsc() - t0, total/1024));
+  shm_detach(r);   // the last attachment, so the segment goes too
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint total;
+
+  total = 4;
+  if(argc > 1)
+    total = atoi(argv[1]);
+  total *= 1024*1024;
+
+  pipebench(total);
+  shmbench(total);
+  exit();
+}
@@ -0,0 +1,247 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size.  It carves single
+// pages from kalloc() into slabs: a struct slab header at the start
+// of the page, then as many objects as fit.  Each object is followed
+// by one word that links it into its slab's free list while it is
+// free, so the object itself is never written by the allocator.
+// That lets a cache keep objects constructed: the constructor runs
+// once per object when its slab is created, and callers must hand
+// objects back to kmem_cache_free() in the constructed state (for
+// example, with their spinlock initialized and released).
+//
+// In front of the slabs each CPU keeps up to NOBJCPU free objects
+// of every cache, used with interrupts off and no lock.  The cache
+// lock is only taken to move NOBJCPU/2 objects between a CPU and
+// the slabs.  A slab whose objects are all free goes back to
+// kalloc(), unless it is the cache's only slab with free objects.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "page.h"
+
+#define NKCACHE  8   // most caches in the system
+#define NOBJCPU  8   // free objects a CPU keeps per cache
+
+struct slab {
+  struct slab *next;        // on the cache's partial list
+  struct slab *prev;
+  void *free;               // first free object
+  int inuse;                // objects handed out
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;                // object size as created
+  uint stride;              // object plus its link word
+  int perslab;              // objects per slab
+  void (*ctor)(void*);
+  struct spinlock lock;
+  struct slab *partial;     // slabs with at least one free object
+  int nslab;                // slabs allocated
+  struct {
+    void *obj[NOBJCPU];
+    int n;
+  } __attribute__((aligned(64))) cpu[NCPU];
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+#define LINK(c, o)  (*(void**)((char*)(o) + (c)->size))
+
+static struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NKCACHE];
+  int n;
+} slabtab;
+
+void
+slabinit(void)
+{
+  initlock(&slabtab.lock, "slabtab");
+}
+
+// Create a cache of objects of the given size.  ctor, if not 0,
+// runs on each object when its slab is created.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size, void (*ctor)(void*))
+{
+  struct kmem_cache *c;
+
+  size = (size + 7) & ~7;
+  if(size == 0 || SLABHDR + size + sizeof(void*) > PGSIZE)
+    panic("kmem_cache_create: size");
+
+  acquire(&slabtab.lock);
+  if(slabtab.n == NKCACHE)
+    panic("kmem_cache_create: too many caches");
+  c = &slabtab.cache[slabtab.n++];
+  release(&slabtab.lock);
+
+  c->name = name;
+  c->size = size;
+  c->stride = size + sizeof(void*);
+  c->perslab = (PGSIZE - SLABHDR) / c->stride;
+  c->ctor = ctor;
+  initlock(&c->lock, name);
+  return c;
+}
+
+static void
+slabunlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slablink(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+// Make a new slab of constructed objects.  Called without c->lock.
+static struct slab*
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  va2page(s)->flags |= PG_SLAB;
+  s->free = 0;
+  s->inuse = 0;
+  for(i = c->perslab - 1; i >= 0; i--){
+    o = (char*)s + SLABHDR + i*c->stride;
+    if(c->ctor)
+      c->ctor(o);
+    LINK(c, o) = s->free;
+    s->free = o;
+  }
+  return s;
+}
+
+// Move up to NOBJCPU/2 objects from the slabs into this CPU's
+// array.  Called with interrupts off.
+static void
+refill(struct kmem_cache *c, int id)
+{
+  struct slab *s;
+  void *o;
+
+  acquire(&c->lock);
+  while(c->cpu[id].n < NOBJCPU/2){
+    if((s = c->partial) == 0){
+      release(&c->lock);
+      s = slabgrow(c);
+      acquire(&c->lock);
+      if(s == 0)
+        break;
+      c->nslab++;
+      slablink(c, s);
+    }
+    o = s->free;
+    s->free = LINK(c, o);
+    s->inuse++;
+    if(s->free == 0)
+      slabunlink(c, s);
+    c->cpu[id].obj[c->cpu[id].n++] = o;
+  }
+  release(&c->lock);
+}
+
+// Return the oldest NOBJCPU/2 objects of this CPU's array to their
+// slabs, and empty slabs to kalloc().  Called with interrupts off.
+static void
+drain(struct kmem_cache *c, int id)
+{
+  struct slab *s, *empty;
+  void *o;
+  int i;
+
+  empty = 0;
+  acquire(&c->lock);
+  for(i = 0; i < NOBJCPU/2; i++){
+    o = c->cpu[id].obj[i];
+    s = (struct slab*)PGROUNDDOWN((uint)o);
+    if(s->free == 0)
+      slablink(c, s);
+    LINK(c, o) = s->free;
+    s->free = o;
+    if(--s->inuse == 0 && (s->prev || s->next)){
+      slabunlink(c, s);
+      c->nslab--;
+      s->next = empty;
+      empty = s;
+    }
+  }
+  release(&c->lock);
+  for(i = NOBJCPU/2; i < c->cpu[id].n; i++)
+    c->cpu[id].obj[i - NOBJCPU/2] = c->cpu[id].obj[i];
+  c->cpu[id].n -= NOBJCPU/2;
+
+  while((s = empty) != 0){
+    empty = s->next;
+    va2page(s)->flags &= ~PG_SLAB;
+    kfree((char*)s);
+  }
+}
+
+// Allocate a constructed object.  Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *o;
+  int id;
+
+  pushcli();
+  id = cpu - cpus;
+  if(c->cpu[id].n == 0)
+    refill(c, id);
+  o = 0;
+  if(c->cpu[id].n > 0)
+    o = c->cpu[id].obj[--c->cpu[id].n];
+  popcli();
+  return o;
+}
+
+// Free an object returned by kmem_cache_alloc(c).
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  int id;
+
+  if(!(va2page(PGROUNDDOWN((uint)o))->flags & PG_SLAB))
+    panic("kmem_cache_free");
+  pushcli();
+  id = cpu - cpus;
+  if(c->cpu[id].n == NOBJCPU)
+    drain(c, id);
+  c->cpu[id].obj[c->cpu[id].n++] = o;
+  popcli();
+}
+
+// Print each cache's size and page use.  Called by procdump.
+void
+slabdump(void)
+{
+  struct kmem_cache *c;
+
+  for(c = slabtab.cache; c < &slabtab.cache[slabtab.n]; c++)
+    cprintf("slab %s: size %d, %d per page, %d pages\n",
+            c->name, c->size, c->perslab, c->nslab);
+}
@@ -1,4 +1,14 @@
 // Mutual exclusion spin locks.
+//
+// Two queue-based flavours sit behind initlock/acquire/release:
+//
+// * Ticket locks (the default).  acquire() takes a ticket with one
+//   atomic add and spins reading lk->owner until its number comes up,
+//   so CPUs enter in FIFO order instead of racing on an xchg.
+//
+// * MCS locks (initmcslock()), for the hottest locks.  Each waiter
+//   spins on a flag in its own per-CPU queue node, so a release
+//   only touches the cache line of the next waiter.
 
 #include "types.h"
 #include "defs.h"
@@ -8,15 +18,127 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// A CPU can hold several MCS locks at once (e.g. ptable.lock
+// and kmem.lock), but never more than NMCSNODE.
+#define NMCSNODE 4
+
+static struct {
+  struct mcsnode node[NMCSNODE];
+} __attribute__((aligned(64))) mcsnodes[NCPU];
+
+// Contention counters, one row per CPU so that updates need no
+// atomics: a CPU only touches its own row, with interrupts off.
+// Locks that share a name share a slot.
+struct lockcount {
+  uint acquires;
+  uint contended;
+  uint64 spin;
+  uint64 maxspin;
+  uint64 hold;
+};
+
+static char *locknames[NLOCKSTAT];
+static struct lockcount lockcounts[NCPU][NLOCKSTAT];
+
+// Find or claim the statistics slot for name.  Lock-free,
+// because kinit1() initializes locks before this CPU's
+// per-cpu segment is set up.  Returns slot+1, or 0 if full.
+static int
+lockslot(char *name)
+{
+  int i;
+
+  if(name == 0)
+    return 0;
+  for(i = 0; i < NLOCKSTAT; i++){
+    if(locknames[i] == 0)
+      cmpxchg((uint*)&locknames[i], 0, (uint)name);
+    if(strncmp(locknames[i], name, sizeof(((struct lockstat*)0)->name)) == 0)
+      return i + 1;
+  }
+  return 0;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+  lk->lsid = lockslot(name);
   lk->locked = 0;
+  lk->type = SPIN_TICKET;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->tail = 0;
+  lk->node = 0;
   lk->cpu = 0;
 }
 
+// Like initlock, but make lk an MCS queue lock.
+void
+initmcslock(struct spinlock *lk, char *name)
+{
+  initlock(lk, name);
+  lk->type = SPIN_MCS;
+}
+
+// Claim a free queue node of this CPU.  Interrupts are off.
+static struct mcsnode*
+mcsalloc(void)
+{
+  struct mcsnode *n;
+
+  for(n = mcsnodes[cpu-cpus].node; n < &mcsnodes[cpu-cpus].node[NMCSNODE]; n++){
+    if(!n->inuse){
+      n->inuse = 1;
+      return n;
+    }
+  }
+  panic("mcsalloc");
+}
+
+// Queue up on lk and wait for our turn.
+// Returns 1 if we had to wait.
+static int
+mcsacquire(struct spinlock *lk)
+{
+  struct mcsnode *n, *pred;
+
+  n = mcsalloc();
+  n->next = 0;
+  n->wait = 1;
+  pred = (struct mcsnode*)xchg((uint*)&lk->tail, (uint)n);
+  if(pred){
+    pred->next = n;
+    while(n->wait)
+      pause();
+  }
+  lk->node = n;
+  return pred != 0;
+}
+
+static void
+mcsrelease(struct spinlock *lk)
+{
+  struct mcsnode *n;
+
+  n = lk->node;
+  lk->node = 0;
+  if(n->next == 0){
+    // No known successor; try to swing tail back to empty.
+    if(cmpxchg((uint*)&lk->tail, (uint)n, 0) == (uint)n){
+      n->inuse = 0;
+      return;
+    }
+    // A waiter is between its xchg and linking itself in.
+    while(n->next == 0)
+      pause();
+  }
+  n->next->wait = 0;
+  n->inuse = 0;
+}
+
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 // Holding a lock for a long time may cause
@@ -24,13 +146,39 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  int contended;
+  uint64 t0, spin;
+  struct lockcount *lc;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  t0 = rdtsc();
+  if(lk->type == SPIN_MCS)
+    contended = mcsacquire(lk);
+  else {
+    // The xadd is atomic; tickets are served in order.
+    ticket = xadd(&lk->next, 1);
+    contended = lk->owner != ticket;
+    while(lk->owner != ticket)
+      pause();
+  }
+  lk->locked = 1;
+  lk->tsc = rdtsc();
+
+  if(lk->lsid){
+    lc = &lockcounts[cpu-cpus][lk->lsid-1];
+    lc->acquires++;
+    if(contended){
+      spin = lk->tsc - t0;
+      lc->contended++;
+      lc->spin += spin;
+      if(spin > lc->maxspin)
+        lc->maxspin = spin;
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -49,8 +197,12 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(lk->lsid)
+    lockcounts[cpu-cpus][lk->lsid-1].hold += rdtsc() - lk->tsc;
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
+  lk->locked = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -59,8 +211,11 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both to not re-order.
   __sync_synchronize();
 
-  // Release the lock.
-  lk->locked = 0;
+  // Release the lock, handing it to the next waiter.
+  if(lk->type == SPIN_MCS)
+    mcsrelease(lk);
+  else
+    lk->owner++;
 
   popcli();
 }
@@ -118,3 +273,72 @@ popcli(void)
     sti();
 }
 
+
+// Locks hammered by lockbench(), one of each type.
+static struct spinlock benchlocks[] = {
+  [SPIN_TICKET] { .type = SPIN_TICKET, .name = "bench-ticket" },
+  [SPIN_MCS]    { .type = SPIN_MCS,    .name = "bench-mcs" },
+};
+static uint benchcount;
+
+// Lock microbenchmark used by the lockbench user program.
+// Repeatedly acquire and release a shared lock of the given
+// type for nticks clock ticks, and return how many times this
+// caller got the lock.  Run one copy per CPU to measure
+// aggregate throughput and how evenly the lock is handed out.
+int
+lockbench(int type, int nticks)
+{
+  struct spinlock *lk;
+  uint t0;
+  int n;
+
+  if(type < 0 || type >= NELEM(benchlocks) || nticks <= 0)
+    return -1;
+  lk = &benchlocks[type];
+  n = 0;
+  t0 = ticks;
+  while(ticks - t0 < nticks){
+    acquire(lk);
+    benchcount++;
+    release(lk);
+    n++;
+  }
+  return n;
+}
+
+// Copy up to n lock statistics into st, summed over CPUs,
+// and return how many were copied.  If reset is set, zero
+// the counters afterwards.  Other CPUs keep counting while
+// we read, so a snapshot is approximate.
+int
+lockstats(struct lockstat *st, int n, int reset)
+{
+  int i, c, k;
+  uint64 spin, maxspin, hold;
+  struct lockcount *lc;
+
+  k = 0;
+  for(i = 0; i < NLOCKSTAT && locknames[i] && k < n; i++){
+    safestrcpy(st[k].name, locknames[i], sizeof(st[k].name));
+    st[k].acquires = 0;
+    st[k].contended = 0;
+    spin = maxspin = hold = 0;
+    for(c = 0; c < ncpu; c++){
+      lc = &lockcounts[c][i];
+      st[k].acquires += lc->acquires;
+      st[k].contended += lc->contended;
+      spin += lc->spin;
+      hold += lc->hold;
+      if(lc->maxspin > maxspin)
+        maxspin = lc->maxspin;
+      if(reset)
+        memset(lc, 0, sizeof(*lc));
+    }
+    st[k].spinkcyc = spin >> 10;
+    st[k].maxspin = maxspin > 0xffffffff ? 0xffffffff : maxspin;
+    st[k].holdkcyc = hold >> 10;
+    k++;
+  }
+  return k;
+}
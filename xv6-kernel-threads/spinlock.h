@@ -1,9 +1,34 @@
 #ifndef XV6_PUBLIC_SPINLOCK_H
 #define XV6_PUBLIC_SPINLOCK_H
 
+// Lock flavours; see initlock() and initmcslock() in spinlock.c.
+#define SPIN_TICKET  0   // FIFO ticket lock (default, also for zeroed locks)
+#define SPIN_MCS     1   // MCS queue lock, each waiter spins on its own line
+
+// Queue node for an MCS lock waiter.  Each CPU owns a few of
+// these (see spinlock.c), one per MCS lock it holds or waits on.
+struct mcsnode {
+  struct mcsnode *volatile next;  // Next waiter in the queue.
+  volatile uint wait;    // Spin here until our predecessor clears it.
+  int inuse;             // Claimed by this CPU?
+};
+
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+  int type;          // SPIN_TICKET or SPIN_MCS
+
+  // Ticket lock state.
+  volatile uint next;     // Next ticket to hand out.
+  volatile uint owner;    // Ticket currently allowed in.
+
+  // MCS lock state.
+  struct mcsnode *tail;   // Last waiter in the queue, 0 if free.
+  struct mcsnode *node;   // Queue node of the current holder.
+
+  // Contention statistics (see lockstat.h).
+  int lsid;          // Slot in lockstats + 1, or 0 if untracked.
+  uint64 tsc;        // rdtsc when the current holder got the lock.
 
   // For debugging:
   char *name;        // Name of lock.
@@ -12,4 +37,4 @@ struct spinlock {
                      // that locked the lock.
 };
 
-#endif
\ No newline at end of file
+#endif
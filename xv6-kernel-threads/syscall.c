@@ -6,6 +6,9 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "trace.h"
+#include "sysreq.h"
+#include "spinlock.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -17,7 +20,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  if(addr >= proc->sz || addr+4 > proc->sz)
+  if(!uservalid(addr, 4))
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -31,10 +34,9 @@ fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
 
-  if(addr >= proc->sz)
+  if((ep = (char*)userend(addr)) == 0)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)proc->sz;
   for(s = *pp; s < ep; s++)
     if(*s == 0)
       return s - *pp;
@@ -59,7 +61,12 @@ argptr(int n, char **pp, int size)
 
   if(argint(n, &i) < 0)
     return -1;
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  if(size < 0 || !uservalid(i, size))
+    return -1;
+  // The kernel may use the buffer while holding a spinlock, when
+  // faulting in file pages would have to sleep, and cannot recover
+  // from running out of memory on a fault.
+  if(vmprefault(i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -67,8 +74,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// The string stays in user memory, so other threads, or other
+// processes through MAP_SHARED or shm, can still change it after
+// this check.
 int
 argstr(int n, char **pp)
 {
@@ -108,6 +116,27 @@ extern int sys_kthread_mutex_alloc(void);
 extern int sys_kthread_mutex_dealloc(void);
 extern int sys_kthread_mutex_lock(void);
 extern int sys_kthread_mutex_unlock(void);
+extern int sys_lockbench(void);
+extern int sys_lockstat(void);
+extern int sys_threadstat(void);
+extern int sys_runlat(void);
+extern int sys_tracectl(void);
+extern int sys_traceread(void);
+extern int sys_profctl(void);
+extern int sys_profread(void);
+extern int sys_aring_setup(void);
+extern int sys_aring_enter(void);
+extern int sys_scstat(void);
+extern int sys_strace(void);
+extern int sys_straceread(void);
+extern int sys_syscall_batch(void);
+extern int sys_allocbench(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shm_create(void);
+extern int sys_shm_attach(void);
+extern int sys_shm_detach(void);
+extern int sys_shm_remove(void);
 
 
 
@@ -141,10 +170,147 @@ static int (*syscalls[])(void) = {
 [SYS_kthread_mutex_alloc] sys_kthread_mutex_alloc,
 [SYS_kthread_mutex_dealloc] sys_kthread_mutex_dealloc,
 [SYS_kthread_mutex_lock] sys_kthread_mutex_lock,
-[SYS_kthread_mutex_unlock] sys_kthread_mutex_unlock
+[SYS_kthread_mutex_unlock] sys_kthread_mutex_unlock,
+[SYS_lockbench] sys_lockbench,
+[SYS_lockstat] sys_lockstat,
+[SYS_threadstat] sys_threadstat,
+[SYS_runlat] sys_runlat,
+[SYS_tracectl] sys_tracectl,
+[SYS_traceread] sys_traceread,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
+[SYS_aring_setup] sys_aring_setup,
+[SYS_aring_enter] sys_aring_enter,
+[SYS_scstat] sys_scstat,
+[SYS_strace] sys_strace,
+[SYS_straceread] sys_straceread,
+[SYS_syscall_batch] sys_syscall_batch,
+[SYS_allocbench] sys_allocbench,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shm_create] sys_shm_create,
+[SYS_shm_attach] sys_shm_attach,
+[SYS_shm_detach] sys_shm_detach,
+[SYS_shm_remove] sys_shm_remove,
 };
 
 
+// System-wide syscall statistics.  Each CPU updates only its own
+// row, with interrupts off, so no lock is needed; scstats() sums
+// the rows.
+static struct scstat cpuscstat[NCPU][NSYSCALLS];
+
+// strace ring.  The oldest entries are overwritten when it fills.
+static struct {
+  struct spinlock lock;
+  uint head;           // Total entries ever written
+  uint tail;           // Next entry straceread() returns
+  struct straceent ent[NSTRACE];
+} stracering;
+
+void
+scstatinit(void)
+{
+  initlock(&stracering.lock, "strace");
+}
+
+// Account one call of syscall num that took d cycles.
+static void
+screcord(int num, uint64 d, uint *arg, int ret)
+{
+  struct scstat *s;
+  struct straceent *e;
+
+  if(num >= NSYSCALLS)
+    return;
+
+  pushcli();
+  s = &cpuscstat[cpu-cpus][num];
+  s->count++;
+  s->cycles += d;
+  s->hist[log2bucket(d, NSCLAT)]++;
+  popcli();
+
+  // Threads of one process may race here; a lost update
+  // now and then is an acceptable price for no lock.
+  proc->sccount[num]++;
+  proc->sccycles[num] += d;
+
+  if(proc->strace){
+    acquire(&stracering.lock);
+    e = &stracering.ent[stracering.head++ % NSTRACE];
+    if(stracering.head - stracering.tail > NSTRACE)
+      stracering.tail = stracering.head - NSTRACE;
+    e->tsc = rdtsc();
+    e->pid = proc->pid;
+    e->tid = thread->tid;
+    e->num = num;
+    e->arg[0] = arg[0];
+    e->arg[1] = arg[1];
+    e->arg[2] = arg[2];
+    e->ret = ret;
+    e->cycles = d >> 32 ? 0xffffffff : (uint)d;
+    release(&stracering.lock);
+  }
+}
+
+// Copy the system-wide statistics for the first n syscall
+// numbers into st and optionally reset them.  Returns n.
+int
+scstats(struct scstat *st, int n, int reset)
+{
+  int c, i, b;
+
+  if(n > NSYSCALLS)
+    n = NSYSCALLS;
+  memset(st, 0, n * sizeof(*st));
+  for(c = 0; c < ncpu; c++){
+    for(i = 0; i < n; i++){
+      st[i].count += cpuscstat[c][i].count;
+      st[i].cycles += cpuscstat[c][i].cycles;
+      for(b = 0; b < NSCLAT; b++)
+        st[i].hist[b] += cpuscstat[c][i].hist[b];
+      if(reset)
+        memset(&cpuscstat[c][i], 0, sizeof(cpuscstat[c][i]));
+    }
+  }
+  return n;
+}
+
+// Move up to n strace entries into e.  Returns how many.
+int
+straceread(struct straceent *e, int n)
+{
+  int k;
+
+  acquire(&stracering.lock);
+  for(k = 0; k < n && stracering.tail != stracering.head; k++)
+    e[k] = stracering.ent[stracering.tail++ % NSTRACE];
+  release(&stracering.lock);
+  return k;
+}
+
+// Run syscall num, whose arguments argint() finds through
+// thread->tf->esp, and account for it.
+static int
+dispatch(int num)
+{
+  uint arg[3] = {0, 0, 0};
+  uint64 t0;
+  int i, ret;
+
+  trace(TR_SYSCALL, num, 0);
+  if(proc->strace)
+    for(i = 0; i < 3; i++)
+      if(argint(i, (int*)&arg[i]) < 0)
+        arg[i] = 0;
+  t0 = rdtsc();
+  ret = syscalls[num]();
+  screcord(num, rdtsc() - t0, arg, ret);
+  trace(TR_SYSRET, num, ret);
+  return ret;
+}
+
 void
 syscall(void)
 {
@@ -152,10 +318,51 @@ syscall(void)
 
   num = thread->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
-    thread->tf->eax = syscalls[num]();
+    thread->tf->eax = dispatch(num);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             thread->tid, proc->name, num);
     thread->tf->eax = -1;
   }
 }
+
+// Run n syscalls described by an array of struct sysreq in one
+// trap, storing each result in its ret field.  Each request is
+// dispatched through syscalls[] with the saved user %esp pointed
+// at it (see sysreq.h), so handlers fetch and check their
+// arguments as usual.  Calls that copy or replace the trap frame
+// (fork, exec) and nested batches fail with -1.  Stops early at a
+// failed request marked SR_STOP, or if the process is killed.
+// Returns the number of requests run.
+int
+sys_syscall_batch(void)
+{
+  struct sysreq *r;
+  uint esp;
+  int i, n, num, ret;
+
+  if(argint(1, &n) < 0 || n < 0 || n > MAXBATCH)
+    return -1;
+  if(argptr(0, (void*)&r, n*sizeof(*r)) < 0)
+    return -1;
+
+  esp = thread->tf->esp;
+  for(i = 0; i < n && !proc->killed; i++){
+    num = r[i].num;
+    if(num <= 0 || num >= NELEM(syscalls) || syscalls[num] == 0 ||
+       num == SYS_fork || num == SYS_exec || num == SYS_syscall_batch){
+      ret = -1;
+    } else {
+      thread->tf->esp = (uint)&r[i];
+      ret = dispatch(num);
+      thread->tf->esp = esp;
+    }
+    // The call may have unmapped the request (sbrk, munmap).
+    if(!uservalid((uint)&r[i], sizeof(r[i])))
+      return i + 1;
+    r[i].ret = ret;
+    if(ret < 0 && (r[i].flags & SR_STOP))
+      return i + 1;
+  }
+  return i;
+}
@@ -29,4 +29,24 @@
 #define SYS_kthread_mutex_lock  28
 #define SYS_kthread_mutex_unlock  29
 #define SYS_procdump  30
-
+#define SYS_lockbench  31
+#define SYS_lockstat  32
+#define SYS_threadstat  33
+#define SYS_runlat  34
+#define SYS_tracectl  35
+#define SYS_traceread  36
+#define SYS_profctl  37
+#define SYS_profread  38
+#define SYS_aring_setup  39
+#define SYS_aring_enter  40
+#define SYS_scstat  41
+#define SYS_strace  42
+#define SYS_straceread  43
+#define SYS_syscall_batch  44
+#define SYS_allocbench  45
+#define SYS_mmap  46
+#define SYS_munmap  47
+#define SYS_shm_create  48
+#define SYS_shm_attach  49
+#define SYS_shm_detach  50
+#define SYS_shm_remove  51
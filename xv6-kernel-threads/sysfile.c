@@ -13,6 +13,7 @@
 #include "fs.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -87,19 +88,30 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Close fd in the current process.
+// Shared by sys_close and the async ring in aring.c.
 int
-sys_close(void)
+closefd(int fd)
 {
-  int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0)
     return -1;
   proc->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+int
+sys_close(void)
+{
+  int fd;
+
+  if(argint(0, &fd) < 0)
+    return -1;
+  return closefd(fd);
+}
+
 int
 sys_fstat(void)
 {
@@ -223,6 +235,8 @@ sys_unlink(void)
 
   ip->nlink--;
   iupdate(ip);
+  if(ip->nlink == 0 && ip->text)
+    textinval(ip);   // let the cache's references go
   iunlockput(ip);
 
   end_op();
@@ -280,17 +294,15 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
+// Open path in the current process and return the new fd.
+// Shared by sys_open and the async ring in aring.c.
 int
-sys_open(void)
+openfd(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   begin_op();
 
   if(omode & O_CREATE){
@@ -330,6 +342,17 @@ sys_open(void)
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openfd(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -439,3 +462,53 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// void *mmap(void *addr, uint len, int prot, int flags, int fd, uint off)
+// addr is only a hint and is ignored.
+int
+sys_mmap(void)
+{
+  int len, prot, flags, off;
+  struct file *f;
+  struct inode *ip;
+  uint filesz;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(!(flags & MAP_SHARED) == !(flags & MAP_PRIVATE))
+    return -1;
+
+  ip = 0;
+  filesz = 0;
+  if(!(flags & MAP_ANON)){
+    if(argfd(4, 0, &f) < 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+    ip = f->ip;
+    ilock(ip);
+    if(ip->type != T_FILE){
+      iunlock(ip);
+      return -1;
+    }
+    if(off < ip->size)
+      filesz = ip->size - off;
+    iunlock(ip);
+    if(filesz > len)
+      filesz = len;
+  }
+  return mmap(len, prot, flags, ip, off, filesz);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return munmap(addr, len);
+}
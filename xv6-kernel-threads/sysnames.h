@@ -0,0 +1,56 @@
+// Syscall names, indexed by the SYS_* numbers in syscall.h, for
+// user tools that print syscalls.  Include after syscall.h.
+
+static char *sysnames[] = {
+  [SYS_fork] "fork",
+  [SYS_exit] "exit",
+  [SYS_wait] "wait",
+  [SYS_pipe] "pipe",
+  [SYS_read] "read",
+  [SYS_kill] "kill",
+  [SYS_exec] "exec",
+  [SYS_fstat] "fstat",
+  [SYS_chdir] "chdir",
+  [SYS_dup] "dup",
+  [SYS_getpid] "getpid",
+  [SYS_sbrk] "sbrk",
+  [SYS_sleep] "sleep",
+  [SYS_uptime] "uptime",
+  [SYS_open] "open",
+  [SYS_write] "write",
+  [SYS_mknod] "mknod",
+  [SYS_unlink] "unlink",
+  [SYS_link] "link",
+  [SYS_mkdir] "mkdir",
+  [SYS_close] "close",
+  [SYS_kthread_create] "kthread_create",
+  [SYS_kthread_id] "kthread_id",
+  [SYS_kthread_exit] "kthread_exit",
+  [SYS_kthread_join] "kthread_join",
+  [SYS_kthread_mutex_alloc] "kthread_mutex_alloc",
+  [SYS_kthread_mutex_dealloc] "kthread_mutex_dealloc",
+  [SYS_kthread_mutex_lock] "kthread_mutex_lock",
+  [SYS_kthread_mutex_unlock] "kthread_mutex_unlock",
+  [SYS_procdump] "procdump",
+  [SYS_lockbench] "lockbench",
+  [SYS_lockstat] "lockstat",
+  [SYS_threadstat] "threadstat",
+  [SYS_runlat] "runlat",
+  [SYS_tracectl] "tracectl",
+  [SYS_traceread] "traceread",
+  [SYS_profctl] "profctl",
+  [SYS_profread] "profread",
+  [SYS_aring_setup] "aring_setup",
+  [SYS_aring_enter] "aring_enter",
+  [SYS_scstat] "scstat",
+  [SYS_strace] "strace",
+  [SYS_straceread] "straceread",
+  [SYS_syscall_batch] "syscall_batch",
+  [SYS_allocbench] "allocbench",
+  [SYS_mmap] "mmap",
+  [SYS_munmap] "munmap",
+  [SYS_shm_create] "shm_create",
+  [SYS_shm_attach] "shm_attach",
+  [SYS_shm_detach] "shm_detach",
+  [SYS_shm_remove] "shm_remove",
+};
@@ -6,6 +6,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "lockstat.h"
+#include "threadstat.h"
+#include "trace.h"
+#include "prof.h"
+#include "aring.h"
 
 int
 sys_fork(void)
@@ -154,3 +159,238 @@ int sys_kthread_mutex_unlock(void) {
         return -1;
     return kthread_mutex_unlock(mutex_id);
 }
+
+int
+sys_lockbench(void)
+{
+  int type, nticks;
+
+  if(argint(0, &type) < 0 || argint(1, &nticks) < 0)
+    return -1;
+  return lockbench(type, nticks);
+}
+
+int
+sys_allocbench(void)
+{
+  int npages, nticks;
+
+  if(argint(0, &npages) < 0 || argint(1, &nticks) < 0)
+    return -1;
+  return kallocbench(npages, nticks);
+}
+
+// Shared memory segments; see shm.c.
+int
+sys_shm_create(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || size <= 0)
+    return -1;
+  return shmcreate(key, size);
+}
+
+int
+sys_shm_attach(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmattach(key);
+}
+
+int
+sys_shm_detach(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdetach(addr);
+}
+
+int
+sys_shm_remove(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmremove(key);
+}
+
+// Copy lock contention statistics to the user buffer,
+// optionally resetting them.  Returns the number of entries.
+int
+sys_lockstat(void)
+{
+  struct lockstat *st;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return lockstats(st, n, reset);
+}
+
+// Copy per-thread CPU accounting to the user buffer.
+// Returns the number of entries.
+int
+sys_threadstat(void)
+{
+  struct threadstat *ts;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NPROC*NTHREAD)
+    n = NPROC*NTHREAD;
+  if(argptr(0, (void*)&ts, n*sizeof(*ts)) < 0)
+    return -1;
+  return threadstats(ts, n);
+}
+
+// Copy per-CPU run-queue latency histograms to the user
+// buffer, NRUNLAT counters per CPU, optionally resetting them.
+// Returns the number of CPUs copied.
+int
+sys_runlat(void)
+{
+  uint *hist;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+    return -1;
+  if(n > NCPU)
+    n = NCPU;
+  if(argptr(0, (void*)&hist, n*NRUNLAT*sizeof(uint)) < 0)
+    return -1;
+  return runlatstats(hist, n, reset);
+}
+
+int
+sys_tracectl(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return tracectl(on != 0);
+}
+
+// Drain buffered trace events into the user buffer.
+// Returns the number of events.
+int
+sys_traceread(void)
+{
+  struct traceevent *ev;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU*NTRACE)
+    n = NCPU*NTRACE;
+  if(argptr(0, (void*)&ev, n*sizeof(*ev)) < 0)
+    return -1;
+  return traceread(ev, n);
+}
+
+int
+sys_profctl(void)
+{
+  int pid, on;
+
+  if(argint(0, &pid) < 0 || argint(1, &on) < 0)
+    return -1;
+  return profctl(pid, on != 0);
+}
+
+// Drain profiler samples into the user buffer.
+// Returns the number of samples.
+int
+sys_profread(void)
+{
+  struct profsample *s;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU*NPROF)
+    n = NCPU*NPROF;
+  if(argptr(0, (void*)&s, n*sizeof(*s)) < 0)
+    return -1;
+  return profread(s, n);
+}
+
+// Register the caller's async syscall ring; see aring.c.
+int
+sys_aring_setup(void)
+{
+  struct aring *r;
+  int flags;
+
+  if(argptr(0, (void*)&r, sizeof(*r)) < 0 || argint(1, &flags) < 0)
+    return -1;
+  return aringsetup(r, flags);
+}
+
+int
+sys_aring_enter(void)
+{
+  int min;
+
+  if(argint(0, &min) < 0)
+    return -1;
+  return aringenter(min);
+}
+
+// Syscall counters: system-wide with latency histograms if pid
+// is 0, else for process pid.  Returns entries filled.
+int
+sys_scstat(void)
+{
+  struct scstat *st;
+  int pid, n, reset;
+
+  if(argint(0, &pid) < 0 || argint(2, &n) < 0 || argint(3, &reset) < 0 || n < 0)
+    return -1;
+  if(n > NSYSCALLS)
+    n = NSYSCALLS;
+  if(argptr(1, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  if(pid == 0)
+    return scstats(st, n, reset);
+  return procscstats(pid, st, n, reset);
+}
+
+int
+sys_strace(void)
+{
+  int pid, on;
+
+  if(argint(0, &pid) < 0 || argint(1, &on) < 0)
+    return -1;
+  return stracectl(pid, on != 0);
+}
+
+int
+sys_straceread(void)
+{
+  struct straceent *e;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSTRACE)
+    n = NSTRACE;
+  if(argptr(0, (void*)&e, n*sizeof(*e)) < 0)
+    return -1;
+  return straceread(e, n);
+}
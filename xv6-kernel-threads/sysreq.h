@@ -0,0 +1,15 @@
+// One request for syscall_batch().  The layout puts the arguments
+// just above num, where the syscall stub's return address would
+// be, so the kernel can point the saved user %esp at &num and run
+// the ordinary syscall handlers unchanged.
+
+#define MAXBATCH 256       // requests per syscall_batch call
+
+#define SR_STOP  1         // stop the batch if this call returns < 0
+
+struct sysreq {
+  int num;                 // SYS_*
+  int arg[5];              // arguments, in order
+  int flags;               // SR_*
+  int ret;                 // result, filled in by the kernel
+};
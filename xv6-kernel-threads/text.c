@@ -0,0 +1,128 @@
+// Cache of program file pages shared between address spaces.
+//
+// When fillpage() (vm.c) reads a page of an exec'd program from its
+// inode, it also leaves the page here, keyed by inode, file offset
+// and length.  The next process to fault on the same page, typically
+// one running the same binary, maps the cached page instead of doing
+// any I/O.  Mappings are read-only; writable segments map it with
+// PTE_WS so that a write takes a private copy (see cowpage).
+//
+// Each entry holds a reference to its page and to its inode, which
+// keeps the in-memory inode, and its text flag, alive.  Writing to
+// the file or unlinking it drops its entries (textinval).  Insertion
+// and invalidation both happen with the inode locked, so a page read
+// before a write cannot be cached after it.  When the cache is full
+// the entries are replaced round robin.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NTEXT 128
+
+struct tpage {
+  struct inode *ip;   // 0 if unused
+  uint off;
+  uint n;             // bytes from the file; the rest is zero
+  char *pg;
+};
+
+static struct {
+  struct spinlock lock;
+  struct tpage ent[NTEXT];
+  int hand;           // next entry to replace
+} textcache;
+
+void
+textinit(void)
+{
+  initlock(&textcache.lock, "text");
+}
+
+// Look up the page holding n bytes of ip at off.  Returns it with
+// a new reference for the caller, or 0.
+char*
+textget(struct inode *ip, uint off, uint n)
+{
+  struct tpage *e;
+  char *pg;
+
+  pg = 0;
+  acquire(&textcache.lock);
+  for(e = textcache.ent; e < &textcache.ent[NTEXT]; e++){
+    if(e->ip == ip && e->off == off && e->n == n){
+      pg = e->pg;
+      kdup(pg);
+      break;
+    }
+  }
+  release(&textcache.lock);
+  return pg;
+}
+
+// Cache pg as the page holding n bytes of ip at off.  The caller
+// holds ip's lock and keeps its own reference to pg.  Returns the
+// inode of a replaced entry, which the caller must iput() inside a
+// transaction, or 0.
+struct inode*
+textput(struct inode *ip, uint off, uint n, char *pg)
+{
+  struct tpage *e;
+  struct inode *old;
+  char *oldpg;
+
+  acquire(&textcache.lock);
+  for(e = textcache.ent; e < &textcache.ent[NTEXT]; e++){
+    if(e->ip == ip && e->off == off && e->n == n){
+      // Another process read the same page meanwhile.
+      release(&textcache.lock);
+      return 0;
+    }
+  }
+  kdup(pg);
+  idup(ip);
+  e = &textcache.ent[textcache.hand];
+  textcache.hand = (textcache.hand + 1) % NTEXT;
+  old = e->ip;
+  oldpg = e->pg;
+  e->ip = ip;
+  e->off = off;
+  e->n = n;
+  e->pg = pg;
+  release(&textcache.lock);
+  ip->text = 1;
+
+  if(old)
+    kfree(oldpg);
+  return old;
+}
+
+// Drop every cached page of ip, whose contents are changing.  The
+// caller holds ip's lock and a reference of its own, so the iput()s
+// here never release the inode.
+void
+textinval(struct inode *ip)
+{
+  struct tpage *e;
+  char *pg;
+
+  for(e = textcache.ent; e < &textcache.ent[NTEXT]; e++){
+    acquire(&textcache.lock);
+    if(e->ip != ip){
+      release(&textcache.lock);
+      continue;
+    }
+    pg = e->pg;
+    e->ip = 0;
+    e->pg = 0;
+    release(&textcache.lock);
+    kfree(pg);
+    iput(ip);
+  }
+  ip->text = 0;
+}
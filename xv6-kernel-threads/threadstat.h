@@ -0,0 +1,12 @@
+// Per-thread CPU usage snapshot returned by threadstat().
+struct threadstat {
+  int pid;           // Owning process
+  int tid;           // Thread ID
+  int state;         // enum threadstate
+  int cpu;           // CPU the thread last ran on
+  uint uticks;       // Timer ticks spent in user mode
+  uint kticks;       // Timer ticks spent in the kernel
+  uint nvcsw;        // Voluntary context switches
+  uint nivcsw;       // Involuntary context switches
+  char name[16];     // Process name
+};
@@ -0,0 +1,75 @@
+// Show per-thread CPU usage, refreshed about once a second.
+//
+// usage: top [iterations]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "threadstat.h"
+
+#define NSTAT 128
+#define INTERVAL 100   // ticks between refreshes
+
+struct threadstat cur[NSTAT], prev[NSTAT];
+int ncur, nprev;
+
+static char *states[] = {
+  "unused", "embryo", "sleep", "runble", "run", "zombie", "invalid",
+};
+
+// Ticks thread st used since the previous snapshot.
+uint
+used(struct threadstat *st)
+{
+  int i;
+
+  for(i = 0; i < nprev; i++)
+    if(prev[i].tid == st->tid)
+      return st->uticks + st->kticks - prev[i].uticks - prev[i].kticks;
+  return st->uticks + st->kticks;
+}
+
+void
+pad(char *s, int w)
+{
+  printf(1, "%s", s);
+  for(w -= strlen(s); w > 0; w--)
+    printf(1, " ");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, iters, t0, t1, dt;
+  struct threadstat *st;
+
+  iters = argc > 1 ? atoi(argv[1]) : -1;
+  nprev = 0;
+  t0 = uptime();
+  while(iters != 0){
+    sleep(INTERVAL);
+    if((ncur = threadstat(cur, NSTAT)) < 0){
+      printf(2, "top: threadstat failed\n");
+      exit();
+    }
+    t1 = uptime();
+    dt = t1 - t0 > 0 ? t1 - t0 : 1;
+
+    printf(1, "\nPID\tTID\tNAME            STATE   CPU\t%%CPU\tUSER\tSYS\tVCSW\tIVCSW\n");
+    for(i = 0; i < ncur; i++){
+      st = &cur[i];
+      printf(1, "%d\t%d\t", st->pid, st->tid);
+      pad(st->name, 16);
+      pad(st->state >= 0 && st->state < sizeof(states)/sizeof(states[0]) ? states[st->state] : "???", 8);
+      printf(1, "%d\t%d\t%d\t%d\t%d\t%d\n", st->cpu, used(st) * 100 / dt,
+             st->uticks, st->kticks, st->nvcsw, st->nivcsw);
+    }
+
+    memmove(prev, cur, ncur * sizeof(cur[0]));
+    nprev = ncur;
+    t0 = t1;
+    if(iters > 0)
+      iters--;
+  }
+  exit();
+}
@@ -0,0 +1,117 @@
+// Kernel event tracing.
+//
+// Each CPU owns a ring of NTRACE events.  Only that CPU writes
+// to its ring, with interrupts off, so recording needs neither
+// a lock nor an atomic instruction and does not perturb the
+// timing of the code being traced the way cprintf would.  When
+// a ring fills up the oldest events are overwritten.
+//
+// traceread() copies events out.  It reads head, copies, and
+// then checks whether the writer lapped it while copying, in
+// which case the possibly torn events are dropped.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "trace.h"
+
+struct tracering {
+  volatile uint head;          // Total events ever written
+  uint tail;                   // Next event traceread() wants
+  struct traceevent ev[NTRACE];
+};
+
+static struct tracering rings[NCPU];
+static struct spinlock tracelock;  // serializes readers
+int traceon;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Record an event on this CPU's ring.
+void
+trace(int type, uint arg, uint arg2)
+{
+  struct tracering *r;
+  struct traceevent *e;
+
+  if(!traceon)
+    return;
+  pushcli();
+  r = &rings[cpu-cpus];
+  e = &r->ev[r->head % NTRACE];
+  e->tsc = rdtsc();
+  e->type = type;
+  e->cpu = cpu-cpus;
+  e->tid = thread ? thread->tid : 0;
+  e->arg = arg;
+  e->arg2 = arg2;
+  __sync_synchronize();
+  r->head++;
+  popcli();
+}
+
+// Turn tracing on or off; returns the previous setting.
+// Turning it on discards anything left in the rings.
+int
+tracectl(int on)
+{
+  int c, old;
+
+  acquire(&tracelock);
+  old = traceon;
+  if(on && !old)
+    for(c = 0; c < ncpu; c++)
+      rings[c].tail = rings[c].head;
+  traceon = on;
+  release(&tracelock);
+  return old;
+}
+
+// Move up to n unread events into ev.
+// Returns the number of events copied.
+int
+traceread(struct traceevent *ev, int n)
+{
+  struct tracering *r;
+  uint h, t, i, d;
+  int c, k, m;
+
+  k = 0;
+  acquire(&tracelock);
+  for(c = 0; c < ncpu && k < n; c++){
+    r = &rings[c];
+    h = r->head;
+    t = r->tail;
+    if(h - t > NTRACE)
+      t = h - NTRACE;   // overwritten before we got to them
+    m = 0;
+    for(i = t; i != h && k + m < n; i++)
+      ev[k + m++] = r->ev[i % NTRACE];
+    r->tail = t + m;
+    __sync_synchronize();
+
+    // The writer may have lapped us while we copied: slots
+    // below head-NTRACE, and the one it is filling at head,
+    // no longer hold what we meant to read.
+    h = r->head;
+    if(h - t >= NTRACE){
+      d = h - t - NTRACE + 1;
+      if(d > m)
+        d = m;
+      memmove(&ev[k], &ev[k + d], (m - d) * sizeof(*ev));
+      m -= d;
+    }
+    k += m;
+  }
+  release(&tracelock);
+  return k;
+}
@@ -0,0 +1,25 @@
+// Kernel event tracing.  Each CPU appends events to its own
+// ring buffer; traceread() drains them.  See trace.c.
+
+#define NTRACE 1024  // events per CPU ring
+
+// Event types, with the meaning of arg and arg2.
+#define TR_SCHED_IN    1   // thread dispatched            arg: pid
+#define TR_SCHED_OUT   2   // thread left the CPU          arg: new state
+#define TR_SYSCALL     3   // syscall entry                arg: number
+#define TR_SYSRET      4   // syscall exit                 arg: number, arg2: return value
+#define TR_SLEEP       5   // thread going to sleep        arg: channel
+#define TR_WAKEUP      6   // wakeup on a channel          arg: channel
+#define TR_IDE_START   7   // disk request issued          arg: block, arg2: 1 if write
+#define TR_IDE_DONE    8   // disk request completed       arg: block
+#define TR_LOG_BEGIN   9   // log commit started           arg: blocks in transaction
+#define TR_LOG_END    10   // log commit finished
+
+struct traceevent {
+  uint64 tsc;        // rdtsc when the event happened
+  ushort type;       // TR_*
+  ushort cpu;        // CPU that recorded it
+  int tid;           // Running thread, or 0 if none
+  uint arg;
+  uint arg2;
+};
@@ -0,0 +1,200 @@
+// Record kernel trace events and save them as Chrome
+// trace-event JSON (load in chrome://tracing or Perfetto).
+// Timestamps are in units of 1024 TSC cycles, not microseconds.
+//
+// usage: tracedump file [command args...]
+// With a command, trace while it runs; otherwise trace for
+// one second.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "trace.h"
+#include "syscall.h"
+#include "sysnames.h"
+
+struct traceevent ev[NCPU*NTRACE];
+
+// Buffered output, since printf writes one byte per syscall.
+static int outfd;
+static char obuf[512];
+static int olen;
+
+void
+flush(void)
+{
+  if(olen > 0)
+    write(outfd, obuf, olen);
+  olen = 0;
+}
+
+void
+puts(char *s)
+{
+  while(*s){
+    if(olen == sizeof(obuf))
+      flush();
+    obuf[olen++] = *s++;
+  }
+}
+
+void
+putu(uint x)
+{
+  char buf[12];
+  int i;
+
+  i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + x % 10;
+  } while((x /= 10) != 0);
+  puts(buf + i);
+}
+
+void
+puti(int x)
+{
+  if(x < 0){
+    puts("-");
+    x = -x;
+  }
+  putu(x);
+}
+
+void
+putx(uint x)
+{
+  char buf[11];
+  int i;
+
+  buf[10] = 0;
+  for(i = 9; i >= 2; i--, x >>= 4)
+    buf[i] = "0123456789abcdef"[x & 0xf];
+  buf[0] = '0';
+  buf[1] = 'x';
+  puts(buf);
+}
+
+// Emit the fields every event shares.
+void
+head(char *name, char *ph, struct traceevent *e, uint64 base)
+{
+  puts("{\"name\":\"");
+  puts(name);
+  puts("\",\"ph\":\"");
+  puts(ph);
+  puts("\",\"ts\":");
+  putu((uint)((e->tsc - base) >> 10));
+  puts(",\"pid\":0,\"tid\":");
+  puti(e->tid);
+}
+
+void
+event(struct traceevent *e, uint64 base)
+{
+  char *sys;
+
+  switch(e->type){
+  case TR_SYSCALL:
+  case TR_SYSRET:
+    sys = e->arg < sizeof(sysnames)/sizeof(sysnames[0]) && sysnames[e->arg] ?
+          sysnames[e->arg] : "syscall";
+    head(sys, e->type == TR_SYSCALL ? "B" : "E", e, base);
+    puts(",\"cat\":\"syscall\"");
+    if(e->type == TR_SYSRET){
+      puts(",\"args\":{\"ret\":");
+      puti(e->arg2);
+      puts("}");
+    }
+    break;
+  case TR_SCHED_IN:
+  case TR_SCHED_OUT:
+    head(e->type == TR_SCHED_IN ? "sched in" : "sched out", "i", e, base);
+    puts(",\"s\":\"t\",\"cat\":\"sched\",\"args\":{\"cpu\":");
+    putu(e->cpu);
+    puts(e->type == TR_SCHED_IN ? ",\"pid\":" : ",\"state\":");
+    putu(e->arg);
+    puts("}");
+    break;
+  case TR_SLEEP:
+  case TR_WAKEUP:
+    head(e->type == TR_SLEEP ? "sleep" : "wakeup", "i", e, base);
+    puts(",\"s\":\"t\",\"cat\":\"sched\",\"args\":{\"chan\":\"");
+    putx(e->arg);
+    puts("\"}");
+    break;
+  case TR_IDE_START:
+  case TR_IDE_DONE:
+    head("ide", e->type == TR_IDE_START ? "b" : "e", e, base);
+    puts(",\"cat\":\"ide\",\"id\":");
+    putu(e->arg);
+    if(e->type == TR_IDE_START)
+      puts(e->arg2 ? ",\"args\":{\"op\":\"write\"}" : ",\"args\":{\"op\":\"read\"}");
+    break;
+  case TR_LOG_BEGIN:
+  case TR_LOG_END:
+    head("log commit", e->type == TR_LOG_BEGIN ? "B" : "E", e, base);
+    puts(",\"cat\":\"log\"");
+    if(e->type == TR_LOG_BEGIN){
+      puts(",\"args\":{\"blocks\":");
+      putu(e->arg);
+      puts("}");
+    }
+    break;
+  default:
+    head("unknown", "i", e, base);
+    puts(",\"s\":\"t\"");
+  }
+  puts("}");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid;
+  uint64 base;
+
+  if(argc < 2){
+    printf(2, "usage: tracedump file [command args...]\n");
+    exit();
+  }
+  unlink(argv[1]);  // O_CREATE does not truncate
+  if((outfd = open(argv[1], O_CREATE|O_WRONLY)) < 0){
+    printf(2, "tracedump: cannot open %s\n", argv[1]);
+    exit();
+  }
+
+  tracectl(1);
+  if(argc > 2){
+    pid = fork();
+    if(pid == 0){
+      exec(argv[2], argv + 2);
+      printf(2, "tracedump: exec %s failed\n", argv[2]);
+      exit();
+    }
+    if(pid > 0)
+      wait();
+  } else
+    sleep(100);
+  tracectl(0);
+
+  n = traceread(ev, NCPU*NTRACE);
+  base = 0;
+  for(i = 0; i < n; i++)
+    if(i == 0 || ev[i].tsc < base)
+      base = ev[i].tsc;
+
+  puts("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"ts_unit\":\"1024 cycles\"},\"traceEvents\":[\n");
+  for(i = 0; i < n; i++){
+    event(&ev[i], base);
+    puts(i + 1 < n ? ",\n" : "\n");
+  }
+  puts("]}\n");
+  flush();
+  close(outfd);
+  printf(1, "tracedump: %d events written to %s\n", n, argv[1]);
+  exit();
+}
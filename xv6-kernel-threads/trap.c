@@ -32,21 +32,29 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// System call entry, from trap() for int $T_SYSCALL and
+// straight from fastsyscall in trapasm.S for sysenter.
+void
+systrap(struct trapframe *tf)
+{
+  if(thread->killed)
+    killSelf();
+  if(proc->killed)
+    exit();
+  thread->tf = tf;
+  syscall();
+  if(thread->killed)
+    killSelf();
+  if(proc->killed)
+    exit();
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {	
   if(tf->trapno == T_SYSCALL){
-    if(thread->killed)
-      killSelf();
-    if(proc->killed)
-      exit();
-    thread->tf = tf;
-    syscall();
-    if(thread->killed)
-      killSelf();
-    if(proc->killed)
-      exit();
+    systrap(tf);
     return;
   }
   
@@ -55,9 +63,19 @@ trap(struct trapframe *tf)
     if(cpunum() == 0){
       acquire(&tickslock);
       ticks++;
+      vdsotick();
       wakeup(&ticks);
       release(&tickslock);
     }
+    // Charge the tick to whichever thread it interrupted.
+    if(thread){
+      if((tf->cs&3) == DPL_USER)
+        thread->uticks++;
+      else
+        thread->kticks++;
+      if(proc->profiling)
+        profsample(tf);
+    }
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -75,6 +93,15 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_IPI:
+    // Another CPU wants us back in the kernel, typically because
+    // our process is exiting; the killed checks below do the rest.
+    // Or it took write access away from pages we may have cached
+    // in the TLB (see tlbshootdown).
+    lcr3(rcr3());
+    cpu->tlbgen++;
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -82,6 +109,11 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    if(pageFault(tf))
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(thread == 0 || (tf->cs&3) == 0){
@@ -98,6 +130,9 @@ trap(struct trapframe *tf)
     proc->killed = 1;
   }
 
+  // Finish the work the interrupt handler put off.
+  rundefer();
+
   // Force process exit if it has been killed and is in user space.
   // (If it is still executing in the kernel, let it keep running
   // until it gets to the regular system call return.)
@@ -108,7 +143,9 @@ trap(struct trapframe *tf)
 
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
-  if(thread && thread->state == TRUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  // Not while running deferred work: that belongs to this CPU.
+  if(thread && thread->state == TRUNNING && tf->trapno == T_IRQ0+IRQ_TIMER &&
+     !cpu->indefer)
     yield();
 
   // Check if the process has been killed since we yielded
@@ -3,6 +3,10 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "kthread.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "vdso.h"
 
 char*
 strcpy(char *s, char *t)
@@ -92,6 +96,35 @@ atoi(const char *s)
   return n;
 }
 
+// Average cycles per call, given the total d for n calls, without
+// the 64-bit division libgcc would have to supply.
+uint
+percall(uint64 d, int n)
+{
+  if(d >> 32)
+    return ((uint)(d >> 10) / n) << 10;
+  return (uint)d / n;
+}
+
+static int nfail;
+
+// For tests: unless ok, print "<what> failed" and count the failure.
+void
+check(char *what, int ok)
+{
+  if(!ok){
+    printf(1, "%s failed\n", what);
+    nfail++;
+  }
+}
+
+// Failed checks so far.
+int
+checkfails(void)
+{
+  return nfail;
+}
+
 void*
 memmove(void *vdst, void *vsrc, int n)
 {
@@ -103,3 +136,26 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// getpid, uptime and kthread_id read what the kernel publishes
+// at VDSO and VPROC (see vdso.h) instead of trapping.
+int
+getpid(void)
+{
+  return ((struct vproc*)VPROC)->pid;
+}
+
+int
+uptime(void)
+{
+  return ((struct vdso*)VDSO)->ticks;
+}
+
+int
+kthread_id()
+{
+  int tid;
+
+  asm volatile("movl %%fs:0, %0" : "=r" (tid));
+  return tid;
+}
@@ -1,5 +1,13 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct threadstat;
+struct traceevent;
+struct profsample;
+struct aring;
+struct scstat;
+struct straceent;
+struct sysreq;
 
 // system calls
 int fork(void);
@@ -32,6 +40,27 @@ int kthread_mutex_dealloc(int mutex_id);
 int kthread_mutex_lock(int mutex_id);
 int kthread_mutex_unlock(int mutex_id);
 void procdump(void);
+int lockbench(int, int);
+int allocbench(int, int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int shm_create(int, uint);
+void* shm_attach(int);
+int shm_detach(void*);
+int shm_remove(int);
+int lockstat(struct lockstat*, int, int);
+int threadstat(struct threadstat*, int);
+int runlat(uint*, int, int);
+int tracectl(int);
+int traceread(struct traceevent*, int);
+int profctl(int, int);
+int profread(struct profsample*, int);
+int aring_setup(struct aring*, int);
+int aring_enter(int);
+int scstat(int, struct scstat*, int, int);
+int strace(int, int);
+int straceread(struct straceent*, int);
+int syscall_batch(struct sysreq*, int);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -46,3 +75,6 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint percall(uint64, int);
+void check(char*, int);
+int checkfails(void);
@@ -0,0 +1,55 @@
+// Kernel data published read-only to user space.
+//
+// vdsopage is ordinary kernel data that setupkvm() maps at VDSO in
+// every address space with PTE_U but not PTE_W; the kernel writes
+// it through its own mapping.  Each process also gets a private
+// page at VPROC (see allocvproc in vm.c) with its pid and the tid
+// of every thread slot.  switchuvm() points the SEG_UTLS segment
+// at the running thread's slot, which user code reaches via %fs.
+//
+// Readers of the 64-bit tsc use the seq field the way a seqlock
+// works: retry if seq was odd or changed while reading.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "vdso.h"
+
+char vdsopage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+// Publish a timer tick.  Called by the CPU that counts ticks,
+// holding tickslock.
+void
+vdsotick(void)
+{
+  struct vdso *v = (struct vdso*)vdsopage;
+  uint64 now;
+
+  now = rdtsc();
+  v->seq++;
+  __sync_synchronize();
+  if(v->tsc)
+    v->tscpertick = now - v->tsc;
+  v->tsc = now;
+  v->ticks = ticks;
+  __sync_synchronize();
+  v->seq++;
+}
+
+// Copy p's pid and thread ids into its VPROC page.
+// Must hold ptable.lock, or own p exclusively.
+void
+vprocfill(struct proc *p)
+{
+  int i;
+
+  if(p->vproc == 0)
+    return;
+  p->vproc->pid = p->pid;
+  for(i = 0; i < NTHREAD; i++)
+    p->vproc->tid[i] = p->threads[i].state == TUNUSED ? 0 : p->threads[i].tid;
+}
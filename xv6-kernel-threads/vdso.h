@@ -0,0 +1,23 @@
+// Read-only pages through which the kernel publishes values that
+// user code would otherwise trap to read.  See vdso.c.
+//
+// VDSO holds one struct vdso shared by every address space.
+// VPROC holds this process's struct vproc, and the %fs segment
+// of each thread is its own tid, so kthread_id() is "movl %fs:0".
+
+#define VDSO   (KERNBASE - 2*PGSIZE)
+#define VPROC  (KERNBASE - PGSIZE)
+#define USERTOP VDSO                // processes grow up to here
+#define MMAPBASE 0x40000000         // heap below, mmap() regions above
+
+struct vdso {
+  volatile uint seq;       // odd while the kernel is updating tsc
+  volatile uint ticks;     // what uptime() returns
+  uint64 tsc;              // rdtsc at the last tick
+  uint tscpertick;         // TSC cycles between the last two ticks
+};
+
+struct vproc {
+  int pid;
+  int tid[NTHREAD];        // by thread slot; 0 if unused
+};
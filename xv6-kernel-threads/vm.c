@@ -6,21 +6,14 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "vdso.h"
+#include "mman.h"
+
+extern void fastsyscall(void);  // trapasm.S
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
-// counter for all proccesses pages possible
-char sharedCounter[60 * 1024]; // 
-
-char
-getSharedCounter(int index)
-{
-  return sharedCounter[index];  
-}
-
-struct spinlock tablelock;
-
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -28,6 +21,7 @@ void
 seginit(void)
 {
   struct cpu *c;
+  uint edx;
 
   // Map "logical" addresses to virtual addresses using identity map.
   // Cannot share a CODE descriptor for both kernel and user
@@ -48,6 +42,16 @@ seginit(void)
   // Initialize cpu-local storage.
   cpu = c;
   proc = 0;
+
+  // Let user code enter the kernel with sysenter, at fastsyscall
+  // in trapasm.S.  The entry stack pointer is this CPU's task
+  // state, from which fastsyscall loads the current esp0.
+  cpuid(1, 0, 0, 0, &edx);
+  if(edx & CPUID_SEP){
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+    wrmsr(MSR_SYSENTER_ESP, (uint)&c->ts);
+    wrmsr(MSR_SYSENTER_EIP, (uint)fastsyscall);
+  }
 }
 
 // Return the address of the PTE in page table pgdir
@@ -63,10 +67,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else { // not presented
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -142,18 +145,36 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
     if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
                 (uint)k->phys_start, k->perm) < 0)
       return 0;
+  // Shared read-only kernel data; see vdso.c.
+  if(mappages(pgdir, (char*)VDSO, PGSIZE, V2P(vdsopage), PTE_U) < 0)
+    return 0;
   return pgdir;
 }
 
+// Give pgdir a fresh, zeroed VPROC page and return its kernel
+// address, for vprocfill() to fill in.  freevm() frees it.
+struct vproc*
+allocvproc(pde_t *pgdir)
+{
+  char *mem;
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(mappages(pgdir, (char*)VPROC, PGSIZE, V2P(mem), PTE_U) < 0){
+    kfree(mem);
+    return 0;
+  }
+  return (struct vproc*)mem;
+}
+
 // Allocate one page table for the machine for the kernel address
 // space for scheduler processes.
 void
@@ -175,6 +196,8 @@ switchkvm(void)
 void
 switchuvm(struct proc *p)
 {
+  uint tid;
+
   pushcli();
   cpu->gdt[SEG_TSS] = SEG16(STS_T32A, &cpu->ts, sizeof(cpu->ts)-1, 0);
   cpu->gdt[SEG_TSS].s = 0;
@@ -184,6 +207,9 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   cpu->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  // User %fs reads this thread's tid; see vdso.h.
+  tid = VPROC + (uint)&((struct vproc*)0)->tid[thread - p->threads];
+  cpu->gdt[SEG_UTLS] = SEG16(0, tid, sizeof(int)-1, DPL_USER);
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
   lcr3(V2P(p->pgdir));  // switch to process's address space
@@ -199,36 +225,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -237,20 +238,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > USERTOP)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -268,40 +268,39 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // process size.  Returns the new process size.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  return deallocuvm_defer(pgdir, oldsz, newsz, 0);
+}
+
+// Like deallocuvm, but for a page table other CPUs may be using:
+// pages whose last reference goes are added to *list (see
+// kfree_defer) for the caller to free after the TLB shootdown.
+int
+deallocuvm_defer(pde_t *pgdir, uint oldsz, uint newsz, uint *list)
 {
   pte_t *pte;
-  uint a, pa, ppn;
+  uint a, pa;
 
   if(newsz >= oldsz)
     return oldsz;
 
-  acquire(&tablelock);
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
-      a += (NPTENTRIES - 1) * PGSIZE;
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;   // skip to the next page table
     else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
-      {
-        release(&tablelock);
         panic("kfree");
-      }
-
-      ppn = (pa >> PTXSHIFT) & 0xFFFFF;
-      // means it was the last page assigned to it
-      if(sharedCounter[ppn] == 0)
-      {
-        char *v = P2V(pa);
-        kfree(v);
-      }
+      // Drops our reference; frees the page if it was not shared.
+      if(list)
+        kfree_defer(P2V(pa), list);
       else
-        sharedCounter[ppn]--;
+        kfree(P2V(pa));
       *pte = 0;
     }
   }
-  release(&tablelock);
   return newsz;
 }
 
@@ -311,14 +310,15 @@ void
 freevm(pde_t *pgdir)
 {
   uint i;
+  pte_t *pte;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
 
+  // The VDSO page is kernel data, not ours to free.
+  if((pte = walkpgdir(pgdir, (char*)VDSO, 0)) != 0)
+    *pte = 0;
   deallocuvm(pgdir, KERNBASE, 0);
-
-  acquire(&tablelock);
-
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -326,7 +326,6 @@ freevm(pde_t *pgdir)
     }
   }
   kfree((char*)pgdir);
-  release(&tablelock);
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -343,36 +342,61 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// Map the present pages of [start, end) in pgdir into d as well.
+// Unless shared, writable pages become copy-on-write in both.
+static int
+copyrange(pde_t *pgdir, pde_t *d, uint start, uint end, int shared)
 {
-  pde_t *d;
   pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
+  uint pa, i;
 
-  if((d = setupkvm()) == 0)
-    return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    // Pages never touched are not mapped yet; the child will
+    // fault them in on its own.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_WS;
     pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
+    kdup(P2V(pa));
+    if(mappages(d, (void*)i, PGSIZE, pa, PTE_FLAGS(*pte)) < 0){
+      kfree(P2V(pa));
+      return -1;
     }
   }
+  return 0;
+}
+
+// Given a parent process's page table and vmas, create a copy
+// of it for a child.  Pages are shared, not copied: writable
+// ones become read-only with PTE_WS set in both page tables, and
+// pageFault() gives a private copy to whichever side writes first.
+// Pages of MAP_SHARED mappings stay writable in both.
+// The caller holds the parent's vmlock, and must flush the parent's
+// TLBs afterwards (see tlbshootdown).
+pde_t*
+copyuvm(pde_t *pgdir, uint sz, struct vma *vma)
+{
+  pde_t *d;
+  struct vma *v;
+
+  if((d = setupkvm()) == 0)
+    return 0;
+  if(copyrange(pgdir, d, 0, sz, 0) < 0)
+    goto bad;
+  for(v = vma; v < &vma[NVMA]; v++)
+    if(v->end && v->start >= sz &&
+       copyrange(pgdir, d, v->start, v->end, v->flags & VMA_SHARED) < 0)
+      goto bad;
+  lcr3(rcr3());
   return d;
 
 bad:
+  lcr3(rcr3());
   freevm(d);
   return 0;
 }
@@ -418,74 +442,592 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
-//handler in case of pagefault
-// 3.2 allocate a new page in physical memorty
-int 
-pageFault(void)
+// The vma covering va in p, or 0.  Caller holds p->vmlock.
+static struct vma*
+findvma(struct proc *p, uint va)
 {
-  uint pa, ppn, addr, flags;
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Map the page at va in the current process, which is not present:
+// from the file behind its vma, or zeroed.  Reading the file may
+// sleep, which is only allowed with interrupts on (no spinlocks
+// held).  Returns 1 if the page is now present, 0 if va is not
+// part of the process or memory or the file read failed.
+static int
+fillpage(uint va)
+{
+  struct vma *v;
+  struct inode *ip, *old;
+  uint off, n;
+  int perm, ok, shared;
   pte_t *pte;
   char *mem;
-  
-  addr = rcr2();
-
-  if(addr==0)
-  {
-    cprintf("ERROR: NULL POINTER EXEPTION!!\n");
-    proc->killed = 1;
-    exit();
-  } 
-  if((pte=walkpgdir(proc->pgdir,(void* )addr,0))==0)
-  {
-    panic("pageFault: pte should exist");
+
+  acquire(&proc->vmlock);
+  v = findvma(proc, va);
+  if(v == 0 && va >= proc->sz)
+    goto bad;
+  if((pte = walkpgdir(proc->pgdir, (void*)va, 0)) != 0 && (*pte & PTE_P)){
+    // Another thread mapped it already.
+    release(&proc->vmlock);
+    return 1;
+  }
+  if(v && v->shm){
+    // Shared memory: map the segment's page.
+    if((mem = shmpage(v->shm, (v->off + (va - v->start)) / PGSIZE)) == 0)
+      goto bad;
+    kdup(mem);
+    if(mappages(proc->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
+      goto oom;
+    }
+    release(&proc->vmlock);
+    return 1;
   }
-  if(!(*pte & PTE_P))
-    panic("pageFault: page not present");
+  if(v == 0 || v->ip == 0 || va - v->start >= v->filesz){
+    // Heap, stack or bss: zero-fill.
+    perm = (v == 0 || (v->flags & VMA_WRITE)) ? PTE_W|PTE_U : PTE_U;
+    if((mem = kalloc_zeroed()) == 0)
+      goto oom;
+    if(mappages(proc->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
+      goto oom;
+    }
+    release(&proc->vmlock);
+    return 1;
+  }
+
+  // File page: take it from the text cache, or read it with the
+  // lock dropped and add it to the cache.  Either way the page is
+  // shared, so map it read-only, copy-on-write if writable.
+  // MAP_SHARED pages are read into a page of their own instead,
+  // which writes go straight to (see writeback).
+  ip = idup(v->ip);
+  off = v->off + (va - v->start);
+  n = v->filesz - (va - v->start);
+  if(n > PGSIZE)
+    n = PGSIZE;
+  shared = v->flags & VMA_SHARED;
+  if(shared)
+    perm = (v->flags & VMA_WRITE) ? PTE_W|PTE_U : PTE_U;
+  else
+    perm = (v->flags & VMA_WRITE) ? PTE_WS|PTE_U : PTE_U;
+  release(&proc->vmlock);
+
+  ok = 0;
+  old = 0;
+  if(!(readeflags() & FL_IF)){
+    cprintf("pid %d %s: page fault at 0x%x needs I/O with locks held\n",
+            proc->pid, proc->name, va);
+    goto putip;
+  }
+  mem = shared ? 0 : textget(ip, off, n);
+  if(mem == 0 && (mem = kalloc_zeroed()) != 0){
+    ilock(ip);
+    if(readi(ip, mem, off, n) != n){
+      kfree(mem);
+      mem = 0;
+    } else if(!shared)
+      old = textput(ip, off, n, mem);
+    iunlock(ip);
+  }
+
+  // The vma may have changed while we slept.
+  acquire(&proc->vmlock);
+  pte = walkpgdir(proc->pgdir, (void*)va, 0);
+  if(pte && (*pte & PTE_P))
+    ok = 1;
+  else if(mem && findvma(proc, va) == v && v->ip == ip &&
+          mappages(proc->pgdir, (char*)va, PGSIZE, V2P(mem), perm) >= 0){
+    ok = 1;
+    mem = 0;
+  }
+  release(&proc->vmlock);
+  if(mem)
+    kfree(mem);
+
+putip:
+  begin_op();
+  if(old)
+    iput(old);   // replaced in the text cache
+  iput(ip);
+  end_op();
+  return ok;
 
+oom:
+  cprintf("pid %d %s: out of memory on page fault\n", proc->pid, proc->name);
+bad:
+  release(&proc->vmlock);
+  return 0;
+}
+
+// Resolve a write to a present, read-only page at va in the
+// current process: copy-on-write, or a stale TLB entry.
+static int
+cowpage(uint va)
+{
+  uint pa;
+  pte_t *pte;
+  char *mem;
+  int ok, moved;
+
+  ok = 0;
+  moved = 0;
+  acquire(&proc->vmlock);
+  if((pte = walkpgdir(proc->pgdir, (void*)va, 0)) == 0 || !(*pte & PTE_P))
+    goto out;
+  if(*pte & PTE_W){
+    // Another thread got here first; our TLB entry is stale.
+    ok = 1;
+    goto out;
+  }
+  if(!(*pte & PTE_WS))
+    goto out;
+
+  // Sole owner: just make the page writable again.  Otherwise
+  // copy it, and drop our reference to the shared page.
   pa = PTE_ADDR(*pte);
-  ppn=( pa >> PTXSHIFT) & 0xFFFFF;
+  if(krefs(P2V(pa)) > 1){
+    if((mem = kalloc()) == 0){
+      cprintf("pid %d %s: out of memory on copy-on-write\n",
+              proc->pid, proc->name);
+      goto out;
+    }
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+    kfree(P2V(pa));
+    moved = 1;
+  }
+  *pte = (*pte & ~PTE_WS) | PTE_W;
+  ok = 1;
+
+out:
+  release(&proc->vmlock);
+  if(ok)
+    invlpg((void*)va);
+  if(moved){
+    // Sibling threads on other CPUs may still read the old frame
+    // through read-only TLB entries.  A fault taken with interrupts
+    // off may hold spinlocks, even ptable.lock, so it cannot wait.
+    if(readeflags() & FL_IF)
+      tlbshootdown(proc);
+    else
+      tlbshootdown_nowait(proc);
+  }
+  return ok;
+}
+
+// Fill in the pages of [addr, addr+n) in the current process that
+// are not present: those backed by a file, or all of them if anon
+// is set, which also gives copy-on-write pages their own copy.
+static int
+vmfill(uint addr, uint n, int anon)
+{
+  uint va;
+  struct vma *v;
+  pte_t *pte;
+  int need;
+
+  if(n == 0)
+    return 0;
+  for(va = PGROUNDDOWN(addr); va < addr + n; va += PGSIZE){
+    acquire(&proc->vmlock);
+    pte = walkpgdir(proc->pgdir, (void*)va, 0);
+    v = findvma(proc, va);
+    need = (pte == 0 || !(*pte & PTE_P)) &&
+           (anon ? v || va < proc->sz : v && v->ip);
+    release(&proc->vmlock);
+    if(need && !fillpage(va))
+      return -1;
+    if(!anon)
+      continue;
+    acquire(&proc->vmlock);
+    pte = walkpgdir(proc->pgdir, (void*)va, 0);
+    need = pte && (*pte & (PTE_P|PTE_W|PTE_WS)) == (PTE_P|PTE_WS);
+    release(&proc->vmlock);
+    if(need && !cowpage(va))
+      return -1;
+  }
+  return 0;
+}
+
+// Make [addr, addr+n) of the current process present and writable,
+// for a buffer the kernel will use: file pages cannot be read in
+// while it holds spinlocks, and a fault taken in the kernel that
+// cannot get memory has no way to fail the system call.  Returns -1
+// if a page could not be filled.
+int
+vmprefault(uint addr, uint n)
+{
+  return vmfill(addr, n, 1);
+}
+
+// Fill in every page of the current process's MAP_SHARED mappings,
+// so that fork() hands the child the same pages rather than letting
+// each side fault in its own.  Returns -1 if a page could not be
+// filled.
+int
+vmfillshared(void)
+{
+  uint start, end;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    acquire(&proc->vmlock);
+    start = proc->vma[i].start;
+    end = proc->vma[i].end;
+    if(!(proc->vma[i].flags & VMA_SHARED))
+      end = 0;
+    release(&proc->vmlock);
+    if(end && vmfill(start, end - start, 1) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// End of the piece of the current process's memory holding addr:
+// sz if addr is below it, else the end of addr's vma, or 0.
+uint
+userend(uint addr)
+{
+  struct vma *v;
+  uint end;
 
   if(addr < proc->sz)
-  {
-    acquire(&tablelock);
+    return proc->sz;
+  acquire(&proc->vmlock);
+  v = findvma(proc, addr);
+  end = v ? v->end : 0;
+  release(&proc->vmlock);
+  return end;
+}
 
-    //checking if there are still process that shared this table, if not we will add writeable on this page
-    if(sharedCounter[ppn] > 0)
-    {
-      if((mem = kalloc()) == 0) //  allocate new page in the physical mem
-        goto bad; 
+// Is [addr, addr+n) memory of the current process: below sz, or
+// inside one vma?
+int
+uservalid(uint addr, uint n)
+{
+  if(addr + n < addr)
+    return 0;
+  if(addr + n <= proc->sz)
+    return 1;
+  return addr + n <= userend(addr);
+}
 
-      memmove(mem, (char*)P2V(pa), PGSIZE);
+// Handle a page fault at the address in %cr2, from user code or
+// from the kernel touching user memory.  Not-present pages of the
+// current process are filled in (see fillpage), and writes to
+// copy-on-write pages get a private copy.  Returns 1 if the
+// faulting instruction can be retried, 0 if the fault is an error.
+int
+pageFault(struct trapframe *tf)
+{
+  uint va;
+  int ok;
 
-      flags = PTE_FLAGS(*pte);
-      flags |= (flags & PTE_WS) ? PTE_W : 0;
-      flags &= flags & ~PTE_WS;
-      flags &= 0x00000FFF;
+  va = PGROUNDDOWN(rcr2());
+  if(proc == 0)
+    return 0;
+  // Page faults arrive with interrupts off.  Filling a page may
+  // sleep on the disk, so run like a system call if we can.
+  if(tf->eflags & FL_IF)
+    sti();
+  ok = 0;
+  if(!(tf->err & FEC_PR))
+    ok = fillpage(va);
+  else if(tf->err & FEC_WR)
+    ok = cowpage(va);
+  cli();   // trap() expects them off again
+  return ok;
+}
+
+// Drop the files behind the vmas in v[0..NVMA-1].
+// Must be called inside a transaction, for iput().
+void
+freevmas(struct vma *v)
+{
+  struct vma *e;
+
+  for(e = v; e < &v[NVMA]; e++){
+    if(e->ip)
+      iput(e->ip);
+    if(e->shm)
+      shmput(e->shm);
+    memset(e, 0, sizeof(*e));
+  }
+}
 
-      *pte &= 0x0;
-      *pte |= flags;
-      *pte |= V2P(mem); // insert the new physical page num and set to writable
+// Copy the vmas in from to to, for fork.
+void
+copyvmas(struct vma *to, struct vma *from)
+{
+  int i;
 
-      sharedCounter[ppn]--;   //decrease the sharing page counter
+  for(i = 0; i < NVMA; i++){
+    to[i] = from[i];
+    if(to[i].ip)
+      idup(to[i].ip);
+    if(to[i].shm)
+      shmdup(to[i].shm);
+  }
+}
+
+// Find room for len bytes, a multiple of PGSIZE, between MMAPBASE
+// and USERTOP in the current process, and return a free vma set to
+// cover it, or 0.  Caller holds proc->vmlock.
+static struct vma*
+vmaplace(uint len)
+{
+  struct vma *v, *e;
+  uint a;
+  int moved;
+
+  if(len == 0 || len > USERTOP - MMAPBASE)
+    return 0;
+  // First fit: move past every vma in the way until none is.
+  a = proc->sz > MMAPBASE ? PGROUNDUP(proc->sz) : MMAPBASE;
+  do {
+    moved = 0;
+    for(e = proc->vma; e < &proc->vma[NVMA]; e++){
+      if(e->end && e->start < a + len && a < e->end){
+        a = e->end;
+        moved = 1;
+      }
     }
-    else if(sharedCounter[ppn]==0)
-    {
-      flags = PTE_FLAGS(*pte);
-      flags |= (flags & PTE_WS) ? PTE_W : 0;
-      flags &= flags & ~PTE_WS;
-
-      *pte &= 0xfffff000;
-      *pte |= flags;
+  } while(moved);
+  for(v = proc->vma; v < &proc->vma[NVMA] && v->end; v++)
+    ;
+  if(a + len > USERTOP || a + len < a || v == &proc->vma[NVMA])
+    return 0;
+  memset(v, 0, sizeof(*v));
+  v->start = a;
+  v->end = a + len;
+  return v;
+}
+
+// Map len bytes of ip from off (or zeros if ip is 0) at a free
+// address between MMAPBASE and USERTOP in the current process.
+// filesz bytes come from the file, the rest is zero.  prot and
+// flags are as for mmap(2).  Pages are filled in on first touch.
+// Returns the address, or -1.
+uint
+mmap(uint len, int prot, int flags, struct inode *ip, uint off, uint filesz)
+{
+  struct vma *v;
+  uint a;
+
+  acquire(&proc->vmlock);
+  if((v = vmaplace(PGROUNDUP(len))) == 0){
+    release(&proc->vmlock);
+    return -1;
+  }
+  a = v->start;
+  v->ip = ip ? idup(ip) : 0;
+  v->off = off;
+  v->filesz = filesz;
+  v->flags = 0;
+  if(prot & PROT_WRITE)
+    v->flags |= VMA_WRITE;
+  if(flags & MAP_SHARED)
+    v->flags |= VMA_SHARED;
+  release(&proc->vmlock);
+  return a;
+}
+
+// Write the dirty pages of MAP_SHARED file mappings in [start, end)
+// of the current process back to their files.  Only the bytes that
+// were in the file when it was mapped are written; a mapping never
+// extends its file.
+static void
+writeback(uint start, uint end)
+{
+  struct vma v;
+  struct inode *ip;
+  pte_t *pte;
+  uint va, n;
+  char *pg;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    acquire(&proc->vmlock);
+    v = proc->vma[i];
+    ip = 0;
+    if(v.end && v.ip && (v.flags & VMA_SHARED) && v.start < end && start < v.end)
+      ip = idup(v.ip);
+    release(&proc->vmlock);
+    if(ip == 0)
+      continue;
+
+    for(va = v.start > start ? v.start : start; va < v.end && va < end; va += PGSIZE){
+      if(va - v.start >= v.filesz)
+        break;
+      // Hold a reference so the page survives a racing munmap
+      // while we write it.
+      pg = 0;
+      acquire(&proc->vmlock);
+      pte = walkpgdir(proc->pgdir, (void*)va, 0);
+      if(pte && (*pte & PTE_P) && (*pte & PTE_D)){
+        *pte &= ~PTE_D;
+        pg = P2V(PTE_ADDR(*pte));
+        kdup(pg);
+      }
+      release(&proc->vmlock);
+      if(pg == 0)
+        continue;
+      n = v.filesz - (va - v.start);
+      if(n > PGSIZE)
+        n = PGSIZE;
+      // A page is at most PGSIZE/BSIZE blocks, within MAXOPBLOCKS.
+      begin_op();
+      ilock(ip);
+      writei(ip, pg, v.off + (va - v.start), n);
+      iunlock(ip);
+      end_op();
+      kfree(pg);
     }
-    else // the counter is zero, and so nobody should point to that page
-      panic("shared counter mismatched");
 
-    release(&tablelock);
-    lcr3(V2P(proc->pgdir)); // flush the TLB
-    return 1;
+    begin_op();
+    iput(ip);
+    end_op();
   }
-  bad:
-  return 0 ;
+}
+
+// Remove [addr, addr+len) from the mmap() region of the current
+// process: write back shared file pages, then drop the pages and
+// trim, split or free the vmas covering it.  Returns -1 if the
+// range is bad or a split needs a vma slot that is not there.
+int
+munmap(uint addr, uint len)
+{
+  struct vma *v, *w, *free;
+  struct inode *drop[NVMA];
+  struct shm *dropshm[NVMA];
+  uint end, d, dead;
+  int i, ndrop;
+
+  end = addr + PGROUNDUP(len);
+  if(addr % PGSIZE != 0 || addr < MMAPBASE || end > USERTOP || end < addr)
+    return -1;
+  if(end == addr)
+    return 0;
+  if(aringpinned(addr, end))
+    return -1;
+
+  writeback(addr, end);
+
+  acquire(&proc->vmlock);
+  // Punching a hole takes a second vma for the upper part.
+  free = 0;
+  w = 0;
+  for(v = proc->vma; v < &proc->vma[NVMA]; v++){
+    if(v->end == 0)
+      free = v;
+    else if(v->start < addr && end < v->end)
+      w = v;
+  }
+  if(w && free == 0){
+    release(&proc->vmlock);
+    return -1;
+  }
+  if(w){
+    *free = *w;
+    d = addr - w->start;
+    free->start = addr;   // trimmed below like any other vma
+    free->off += d;
+    free->filesz = free->filesz > d ? free->filesz - d : 0;
+    if(free->ip)
+      idup(free->ip);
+    if(free->shm)
+      shmdup(free->shm);
+    w->end = addr;
+    if(w->filesz > addr - w->start)
+      w->filesz = addr - w->start;
+  }
+
+  ndrop = 0;
+  for(v = proc->vma; v < &proc->vma[NVMA]; v++){
+    if(v->end == 0 || v->end <= addr || end <= v->start)
+      continue;
+    if(addr <= v->start && v->end <= end){
+      dropshm[ndrop] = v->shm;
+      drop[ndrop++] = v->ip;
+      memset(v, 0, sizeof(*v));
+    } else if(addr <= v->start){
+      d = end - v->start;
+      v->start = end;
+      v->off += d;
+      v->filesz = v->filesz > d ? v->filesz - d : 0;
+    } else {
+      v->end = addr;
+      if(v->filesz > addr - v->start)
+        v->filesz = addr - v->start;
+    }
+  }
+  dead = 0;
+  deallocuvm_defer(proc->pgdir, end, addr, &dead);
+  lcr3(V2P(proc->pgdir));
+  release(&proc->vmlock);
+  // Siblings may still map the pages; free them only after.
+  tlbshootdown(proc);
+  kfreelist(dead);
+
+  begin_op();
+  for(i = 0; i < ndrop; i++){
+    if(drop[i])
+      iput(drop[i]);
+    if(dropshm[i])
+      shmput(dropshm[i]);
+  }
+  end_op();
+  return 0;
+}
+
+// Map the shared memory segment under key into the current process
+// (see shm.c).  Returns its address, or -1.
+uint
+shmattach(int key)
+{
+  struct shm *s;
+  struct vma *v;
+  uint a;
+
+  if((s = shmget(key)) == 0)
+    return -1;
+  acquire(&proc->vmlock);
+  if((v = vmaplace(shmsize(s))) == 0){
+    release(&proc->vmlock);
+    shmput(s);
+    return -1;
+  }
+  a = v->start;
+  v->shm = s;
+  v->flags = VMA_WRITE | VMA_SHARED;
+  release(&proc->vmlock);
+  return a;
+}
+
+// Unmap the shared memory segment attached at addr.
+int
+shmdetach(uint addr)
+{
+  struct vma *v;
+  uint len;
+
+  acquire(&proc->vmlock);
+  v = findvma(proc, addr);
+  len = 0;
+  if(v && v->shm && v->start == addr)
+    len = v->end - v->start;
+  release(&proc->vmlock);
+  if(len == 0)
+    return -1;
+  return munmap(addr, len);
 }
 
 //PAGEBREAK!
@@ -130,6 +130,97 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add inc to *addr and return the old value.
+static inline uint
+xadd(volatile uint *addr, uint inc)
+{
+  uint result;
+
+  asm volatile("lock; xaddl %0, %1" :
+               "=r" (result), "+m" (*addr) :
+               "0" (inc) :
+               "memory", "cc");
+  return result;
+}
+
+// Atomically set *addr to newval if it still holds oldval.
+// Returns the value *addr held before the instruction.
+static inline uint
+cmpxchg(volatile uint *addr, uint oldval, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (oldval) :
+               "memory", "cc");
+  return result;
+}
+
+// Hint to the CPU that we are in a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Read the CPU's time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+// Bucket of a log2 histogram with nb buckets for d: bucket b
+// holds [2^b, 2^(b+1)), bucket 0 also 0, the last everything above.
+static inline int
+log2bucket(uint64 d, int nb)
+{
+  int b;
+
+  if(d >> 32)
+    b = 63 - __builtin_clz((uint)(d >> 32));
+  else if(d)
+    b = 31 - __builtin_clz((uint)d);
+  else
+    b = 0;
+  return b < nb ? b : nb - 1;
+}
+
+static inline void
+cpuid(uint info, uint *eaxp, uint *ebxp, uint *ecxp, uint *edxp)
+{
+  uint eax, ebx, ecx, edx;
+
+  asm volatile("cpuid" :
+               "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+               "a" (info));
+  if(eaxp)
+    *eaxp = eax;
+  if(ebxp)
+    *ebxp = ebx;
+  if(ecxp)
+    *ecxp = ecx;
+  if(edxp)
+    *edxp = edx;
+}
+
+#define CPUID_SEP  (1<<11)   // cpuid(1) %edx: has sysenter/sysexit
+
+// Model-specific registers for the sysenter instruction.
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
+
+static inline void
+wrmsr(uint msr, uint64 val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" ((uint)val), "d" ((uint)(val >> 32)));
+}
+
 static inline uint
 rcr2(void)
 {
@@ -138,6 +229,20 @@ rcr2(void)
   return val;
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
 static inline void
 lcr3(uint val)
 {